@@ -57,6 +57,7 @@ static opl_driver_t *driver = NULL;
 static int init_stage_reg_writes = 1;
 
 unsigned int opl_sample_rate = 22050;
+unsigned int opl_max_slice_ms = 100;
 
 //
 // Init/shutdown code.
@@ -179,6 +180,14 @@ void OPL_SetSampleRate(unsigned int rate)
     opl_sample_rate = rate;
 }
 
+// Set the maximum mixing slice length, if software emulation has to
+// open the audio device itself.
+
+void OPL_SetMaxSliceTime(unsigned int ms)
+{
+    opl_max_slice_ms = ms;
+}
+
 void OPL_WritePort(opl_port_t port, unsigned int value)
 {
     if (driver != NULL)
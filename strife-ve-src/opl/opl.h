@@ -74,6 +74,10 @@ void OPL_Shutdown(void);
 
 void OPL_SetSampleRate(unsigned int rate);
 
+// Set the maximum audio slice length (in ms) used for software emulation.
+
+void OPL_SetMaxSliceTime(unsigned int ms);
+
 // Write to one of the OPL I/O ports:
 
 void OPL_WritePort(opl_port_t port, unsigned int value);
@@ -54,5 +54,9 @@ typedef struct
 
 extern unsigned int opl_sample_rate;
 
+// Maximum audio slice length, in ms.
+
+extern unsigned int opl_max_slice_ms;
+
 #endif /* #ifndef OPL_INTERNAL_H */
 
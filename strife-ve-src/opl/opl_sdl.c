@@ -32,7 +32,10 @@
 
 #include "opl_queue.h"
 
-#define MAX_SOUND_SLICE_TIME 100 /* ms */
+// Size of the control thread -> mixing thread command queue; must be
+// a power of two.
+
+#define CMD_QUEUE_SIZE 256
 
 typedef struct
 {
@@ -47,13 +50,45 @@ typedef struct
 
 static SDL_mutex *callback_mutex = NULL;
 
-// Queue of callbacks waiting to be invoked.
+// Queue of callbacks waiting to be invoked. Only the mixing thread
+// touches this; the control thread sends it commands through cmd_queue.
 
 static opl_callback_queue_t *callback_queue;
 
-// Mutex used to control access to the callback queue.
+// Lock-free single-producer, single-consumer queue of commands from the
+// control thread. Callbacks that schedule new callbacks run on the mixing
+// thread and push to callback_queue directly, so there is only ever one
+// producer.
+
+typedef enum
+{
+    OPL_CMD_SET_CALLBACK,
+    OPL_CMD_CLEAR_CALLBACKS,
+    OPL_CMD_ADJUST_CALLBACKS,
+} opl_cmd_type_t;
+
+typedef struct
+{
+    opl_cmd_type_t type;
+    uint64_t us;
+    opl_callback_t callback;
+    void *data;
+    float factor;
+} opl_cmd_t;
+
+static opl_cmd_t cmd_queue[CMD_QUEUE_SIZE];
+static SDL_atomic_t cmd_head;
+static SDL_atomic_t cmd_tail;
+
+// Bumped every time the callback queue is cleared, so that a callback
+// popped just before a clear is not invoked after it.
 
-static SDL_mutex *callback_queue_mutex = NULL;
+static unsigned int clear_generation;
+
+// Thread running OPL_Mix_Callback, and whether it is inside it.
+
+static SDL_threadID mixing_thread;
+static SDL_atomic_t in_mix_callback;
 
 // Current time, in us since startup:
 
@@ -99,6 +134,76 @@ static int SDLIsInitialized(void)
     return Mix_QuerySpec(&freq, &format, &channels);
 }
 
+// Apply commands sent by the control thread. Must only be called from
+// the mixing thread.
+
+static void ProcessCommands(void)
+{
+    unsigned int head, tail;
+    opl_cmd_t *cmd;
+
+    tail = (unsigned int) SDL_AtomicGet(&cmd_tail);
+    head = (unsigned int) SDL_AtomicGet(&cmd_head);
+
+    while (tail != head)
+    {
+        cmd = &cmd_queue[tail & (CMD_QUEUE_SIZE - 1)];
+
+        switch (cmd->type)
+        {
+            case OPL_CMD_SET_CALLBACK:
+                OPL_Queue_Push(callback_queue, cmd->callback, cmd->data,
+                               current_time - pause_offset + cmd->us);
+                break;
+
+            case OPL_CMD_CLEAR_CALLBACKS:
+                OPL_Queue_Clear(callback_queue);
+                ++clear_generation;
+                break;
+
+            case OPL_CMD_ADJUST_CALLBACKS:
+                OPL_Queue_AdjustCallbacks(callback_queue, current_time,
+                                          cmd->factor);
+                break;
+        }
+
+        ++tail;
+        SDL_AtomicSet(&cmd_tail, (int) tail);
+    }
+}
+
+// Send a command to the mixing thread. If the queue is full, wait for
+// the mixing thread to drain it.
+
+static void PushCommand(const opl_cmd_t *cmd)
+{
+    unsigned int head, tail;
+
+    head = (unsigned int) SDL_AtomicGet(&cmd_head);
+
+    for (;;)
+    {
+        tail = (unsigned int) SDL_AtomicGet(&cmd_tail);
+
+        if (head - tail < CMD_QUEUE_SIZE)
+        {
+            break;
+        }
+
+        SDL_Delay(1);
+    }
+
+    cmd_queue[head & (CMD_QUEUE_SIZE - 1)] = *cmd;
+    SDL_AtomicSet(&cmd_head, (int) (head + 1));
+}
+
+// Returns true if called from within OPL_Mix_Callback.
+
+static int OnMixingThread(void)
+{
+    return SDL_AtomicGet(&in_mix_callback) && SDL_ThreadID() == mixing_thread;
+}
+
 // Advance time by the specified number of samples, invoking any
 // callback functions as appropriate.
 
@@ -106,10 +211,9 @@ static void AdvanceTime(unsigned int nsamples)
 {
     opl_callback_t callback;
     void *callback_data;
+    unsigned int generation;
     uint64_t us;
 
-    SDL_LockMutex(callback_queue_mutex);
-
     // Advance time.
 
     us = ((uint64_t) nsamples * OPL_SECOND) / mixing_freq;
@@ -123,9 +227,16 @@ static void AdvanceTime(unsigned int nsamples)
     // Are there callbacks to invoke now?  Keep invoking them
     // until there are no more left.
 
-    while (!OPL_Queue_IsEmpty(callback_queue)
-        && current_time >= OPL_Queue_Peek(callback_queue) + pause_offset)
+    for (;;)
     {
+        ProcessCommands();
+
+        if (OPL_Queue_IsEmpty(callback_queue)
+         || current_time < OPL_Queue_Peek(callback_queue) + pause_offset)
+        {
+            break;
+        }
+
         // Pop the callback from the queue to invoke it.
 
         if (!OPL_Queue_Pop(callback_queue, &callback, &callback_data))
@@ -133,23 +244,31 @@ static void AdvanceTime(unsigned int nsamples)
             break;
         }
 
-        // The mutex stuff here is a bit complicated.  We must
-        // hold callback_mutex when we invoke the callback (so that
-        // the control thread can use OPL_Lock() to prevent callbacks
-        // from being invoked), but we must not be holding
-        // callback_queue_mutex, as the callback must be able to
-        // call OPL_SetCallback to schedule new callbacks.
+        // We must hold callback_mutex when we invoke the callback, so
+        // that the control thread can use OPL_Lock() to prevent callbacks
+        // from being invoked. The control thread may be waiting on a full
+        // command queue while holding it, so keep draining commands
+        // rather than blocking.
 
-        SDL_UnlockMutex(callback_queue_mutex);
+        generation = clear_generation;
 
-        SDL_LockMutex(callback_mutex);
-        callback(callback_data);
-        SDL_UnlockMutex(callback_mutex);
+        while (SDL_TryLockMutex(callback_mutex) != 0)
+        {
+            ProcessCommands();
+            SDL_Delay(0);
+        }
 
-        SDL_LockMutex(callback_queue_mutex);
-    }
+        // Drop the callback if the queue was cleared while we waited.
+
+        ProcessCommands();
+
+        if (generation == clear_generation)
+        {
+            callback(callback_data);
+        }
 
-    SDL_UnlockMutex(callback_queue_mutex);
+        SDL_UnlockMutex(callback_mutex);
+    }
 }
 
 // Call the OPL emulator code to fill the specified buffer.
@@ -190,6 +309,9 @@ static void OPL_Mix_Callback(void *udata,
     buffer = (int16_t *) byte_buffer;
     buffer_len = buffer_bytes / 4;
 
+    mixing_thread = SDL_ThreadID();
+    SDL_AtomicSet(&in_mix_callback, 1);
+
     // Repeatedly call the OPL emulator update function until the buffer is
     // full.
 
@@ -198,7 +320,7 @@ static void OPL_Mix_Callback(void *udata,
         uint64_t next_callback_time;
         uint64_t nsamples;
 
-        SDL_LockMutex(callback_queue_mutex);
+        ProcessCommands();
 
         // Work out the time until the next callback waiting in
         // the callback queue must be invoked.  We can then fill the
@@ -221,8 +343,6 @@ static void OPL_Mix_Callback(void *udata,
             }
         }
 
-        SDL_UnlockMutex(callback_queue_mutex);
-
         // Add emulator output to buffer.
 
         FillBuffer(buffer + filled * 2, nsamples);
@@ -232,6 +352,8 @@ static void OPL_Mix_Callback(void *udata,
 
         AdvanceTime(nsamples);
     }
+
+    SDL_AtomicSet(&in_mix_callback, 0);
 }
 
 static void OPL_SDL_Shutdown(void)
@@ -260,12 +382,6 @@ static void OPL_SDL_Shutdown(void)
         SDL_DestroyMutex(callback_mutex);
         callback_mutex = NULL;
     }
-
-    if (callback_queue_mutex != NULL)
-    {
-        SDL_DestroyMutex(callback_queue_mutex);
-        callback_queue_mutex = NULL;
-    }
 }
 
 static unsigned int GetSliceSize(void)
@@ -273,7 +389,7 @@ static unsigned int GetSliceSize(void)
     int limit;
     int n;
 
-    limit = (opl_sample_rate * MAX_SOUND_SLICE_TIME) / 1000;
+    limit = (opl_sample_rate * opl_max_slice_ms) / 1000;
 
     // Try all powers of two, not exceeding the limit.
 
@@ -332,6 +448,11 @@ static int OPL_SDL_Init(unsigned int port_base)
 
     callback_queue = OPL_Queue_Create();
     current_time = 0;
+    clear_generation = 0;
+
+    SDL_AtomicSet(&cmd_head, 0);
+    SDL_AtomicSet(&cmd_tail, 0);
+    SDL_AtomicSet(&in_mix_callback, 0);
 
     // Get the mixer frequency, format and number of channels.
 
@@ -360,7 +481,6 @@ static int OPL_SDL_Init(unsigned int port_base)
     Chip__Setup(&opl_chip, mixing_freq);
 
     callback_mutex = SDL_CreateMutex();
-    callback_queue_mutex = SDL_CreateMutex();
 
     // TODO: This should be music callback? or-?
     Mix_HookMusic(OPL_Mix_Callback, NULL);
@@ -461,17 +581,40 @@ static void OPL_SDL_SetCallback(uint64_t us,
                                 opl_callback_t callback,
                                 void *data)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_Push(callback_queue, callback, data,
-                   current_time - pause_offset + us);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_cmd_t cmd;
+
+    // Callbacks scheduling further callbacks are already on the
+    // mixing thread and own the queue.
+
+    if (OnMixingThread())
+    {
+        OPL_Queue_Push(callback_queue, callback, data,
+                       current_time - pause_offset + us);
+        return;
+    }
+
+    cmd.type = OPL_CMD_SET_CALLBACK;
+    cmd.us = us;
+    cmd.callback = callback;
+    cmd.data = data;
+    cmd.factor = 1.0f;
+    PushCommand(&cmd);
 }
 
 static void OPL_SDL_ClearCallbacks(void)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_Clear(callback_queue);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_cmd_t cmd;
+
+    if (OnMixingThread())
+    {
+        OPL_Queue_Clear(callback_queue);
+        ++clear_generation;
+        return;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = OPL_CMD_CLEAR_CALLBACKS;
+    PushCommand(&cmd);
 }
 
 static void OPL_SDL_Lock(void)
@@ -491,9 +634,18 @@ static void OPL_SDL_SetPaused(int paused)
 
 static void OPL_SDL_AdjustCallbacks(float factor)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_AdjustCallbacks(callback_queue, current_time, factor);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_cmd_t cmd;
+
+    if (OnMixingThread())
+    {
+        OPL_Queue_AdjustCallbacks(callback_queue, current_time, factor);
+        return;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = OPL_CMD_ADJUST_CALLBACKS;
+    cmd.factor = factor;
+    PushCommand(&cmd);
 }
 
 opl_driver_t opl_sdl_driver =
@@ -751,6 +751,7 @@ void TryRunTics (void)
     int realtics;
     int	availabletics;
     int	counts;
+    int	runstart;
     boolean caninterpolate = (gametic > 0 && d_interpolate); // haleyjd
 
     // get real tics
@@ -830,6 +831,8 @@ void TryRunTics (void)
         I_Sleep(1);
     }
     
+    runstart = I_GetTimeMS();
+
     // run the count * ticdup dics
     while (counts--)
     {
@@ -864,6 +867,18 @@ void TryRunTics (void)
 	}
 
 	NetUpdate ();	// check for new console commands
+
+        // [SVE]: frame pacing. When interpolating a local game, stop
+        // once a tic's worth of time has gone into running tics, so a
+        // slow stretch still gets an interpolated frame drawn between
+        // tics. Only leave a single tic queued: BuildNewTic stops
+        // building past a small single player backlog, and any time
+        // that passes while it is full is lost to the game.
+        if (caninterpolate && !net_client_connected && counts == 1
+         && I_GetTimeMS() - runstart >= 1000 / TICRATE)
+        {
+            return;
+        }
     }
 }
 
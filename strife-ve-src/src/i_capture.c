@@ -0,0 +1,724 @@
+//
+// Copyright(C) 2014 Night Dive Studios, Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//    In-engine gameplay capture.
+//
+//    Frames are grabbed on a fixed capture clock as they are presented,
+//    either from the 320x200 software screen or by reading back the GL
+//    back buffer through a ring of pixel buffer objects, so the read
+//    completes a couple of frames later without stalling the pipeline.
+//    Each encoder thread owns one single-producer ring of frames and
+//    writes them out as PNGs; the game thread never waits on a ring and
+//    drops the frame instead when all of them are full. Mixer output is
+//    tapped with a post-mix effect into another ring and written to a
+//    WAV file by the first encoder thread.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "SDL_mixer.h"
+
+#include <png.h>
+
+#include "i_capture.h"
+#include "i_spscqueue.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "rb_main.h"
+
+#ifndef GL_PIXEL_PACK_BUFFER_ARB
+#define GL_PIXEL_PACK_BUFFER_ARB    0x88EB
+#endif
+
+#ifndef GL_STREAM_READ_ARB
+#define GL_STREAM_READ_ARB          0x88E1
+#endif
+
+#ifndef GL_READ_ONLY_ARB
+#define GL_READ_ONLY_ARB            0x88B8
+#endif
+
+#define CAPTURE_MAX_ENCODERS    4
+#define CAPTURE_QUEUE_FRAMES    4
+#define CAPTURE_PBOS            3
+#define CAPTURE_AUDIO_CHUNK     4096
+#define CAPTURE_AUDIO_CHUNKS    64
+
+typedef struct
+{
+    byte        *buffer;
+    int         size;       // allocated bytes
+    int         width;
+    int         height;
+    boolean     flipped;    // rows are bottom-up (GL readback)
+    int         number;
+} captureframe_t;
+
+typedef struct
+{
+    int         size;
+    byte        data[CAPTURE_AUDIO_CHUNK];
+} captureaudio_t;
+
+typedef struct
+{
+    spscqueue_t queue;
+    SDL_Thread  *thread;
+    int         index;
+} captureencoder_t;
+
+capturestats_t capturestats;
+
+static char *capturedir;
+static int capturerate = TICRATE;
+static int capturestart;
+static int capturelast = -1;
+static int nextencoder;
+
+static captureencoder_t encoders[CAPTURE_MAX_ENCODERS];
+static int numencoders;
+static SDL_atomic_t capturerunning;
+
+// GL readback
+static boolean glchecked;
+static boolean usepbo;
+static GLuint pbos[CAPTURE_PBOS];
+static int pbonumber[CAPTURE_PBOS];
+static int pbowidth;
+static int pboheight;
+static int pbocurrent;
+
+// mixer tap
+static boolean captureaudio;
+static spscqueue_t audioqueue;
+static SDL_atomic_t audiodropped;
+static FILE *wavfile;
+static unsigned int wavbytes;
+
+//
+// CaptureWriteLE
+//
+
+static void CaptureWriteLE(FILE *f, unsigned int value, int bytes)
+{
+    int i;
+
+    for(i = 0; i < bytes; i++)
+    {
+        fputc((value >> (i * 8)) & 0xff, f);
+    }
+}
+
+//
+// CaptureWriteWAVHeader
+//
+// Written once with empty sizes, and again at shutdown with the real
+// ones.
+//
+
+static void CaptureWriteWAVHeader(int freq, int channels)
+{
+    fseek(wavfile, 0, SEEK_SET);
+
+    fwrite("RIFF", 1, 4, wavfile);
+    CaptureWriteLE(wavfile, 36 + wavbytes, 4);
+    fwrite("WAVEfmt ", 1, 8, wavfile);
+    CaptureWriteLE(wavfile, 16, 4);
+    CaptureWriteLE(wavfile, 1, 2);                  // PCM
+    CaptureWriteLE(wavfile, channels, 2);
+    CaptureWriteLE(wavfile, freq, 4);
+    CaptureWriteLE(wavfile, freq * channels * 2, 4);
+    CaptureWriteLE(wavfile, channels * 2, 2);
+    CaptureWriteLE(wavfile, 16, 2);
+    fwrite("data", 1, 4, wavfile);
+    CaptureWriteLE(wavfile, wavbytes, 4);
+}
+
+//
+// CaptureAudioEffect
+//
+// Runs on the mixer thread after everything has been mixed.
+//
+
+static void CaptureAudioEffect(int chan, void *stream, int len, void *udata)
+{
+    byte *src = (byte *)stream;
+    captureaudio_t *chunk;
+
+    while(len > 0)
+    {
+        if((chunk = I_SPSCWriteSlot(&audioqueue)) == NULL)
+        {
+            SDL_AtomicAdd(&audiodropped, 1);
+            return;
+        }
+
+        chunk->size = MIN(len, CAPTURE_AUDIO_CHUNK);
+        memcpy(chunk->data, src, chunk->size);
+        I_SPSCCommitWrite(&audioqueue);
+
+        src += chunk->size;
+        len -= chunk->size;
+    }
+}
+
+//
+// CaptureWriteAudio
+//
+
+static boolean CaptureWriteAudio(void)
+{
+    captureaudio_t *chunk;
+    boolean wrote = false;
+
+    while((chunk = I_SPSCReadSlot(&audioqueue)) != NULL)
+    {
+        fwrite(chunk->data, 1, chunk->size, wavfile);
+        wavbytes += chunk->size;
+        I_SPSCCommitRead(&audioqueue);
+        wrote = true;
+    }
+
+    return wrote;
+}
+
+//
+// CaptureWritePNG
+//
+
+static void CaptureWritePNG(captureframe_t *frame)
+{
+    char filename[256];
+    png_structp png;
+    png_infop info;
+    FILE *handle;
+    int i;
+
+    M_snprintf(filename, sizeof(filename), "%s" DIR_SEPARATOR_S "frame%06i.png",
+               capturedir, frame->number);
+
+    if(!(handle = fopen(filename, "wb")))
+    {
+        return;
+    }
+
+    // the default error handler reports and longjmps back here
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct(png) : NULL;
+
+    if(!info || setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_write_struct(&png, &info);
+        fclose(handle);
+        return;
+    }
+
+    png_init_io(png, handle);
+
+    // throughput matters more than file size here
+    png_set_compression_level(png, 1);
+
+    png_set_IHDR(png, info, frame->width, frame->height, 8,
+                 PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_DEFAULT);
+
+    png_write_info(png, info);
+
+    for(i = 0; i < frame->height; i++)
+    {
+        int row = frame->flipped ? frame->height - 1 - i : i;
+        png_write_row(png, frame->buffer + row * frame->width * 3);
+    }
+
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    fclose(handle);
+}
+
+//
+// CaptureEncoderThread
+//
+
+static int SDLCALL CaptureEncoderThread(void *data)
+{
+    captureencoder_t *encoder = (captureencoder_t *)data;
+    captureframe_t *frame;
+    boolean running;
+    boolean idle;
+
+    while(1)
+    {
+        // read the flag before the rings, so nothing queued ahead of
+        // the shutdown is left behind
+        running = SDL_AtomicGet(&capturerunning);
+        idle = true;
+
+        if((frame = I_SPSCReadSlot(&encoder->queue)) != NULL)
+        {
+            CaptureWritePNG(frame);
+            I_SPSCCommitRead(&encoder->queue);
+            idle = false;
+        }
+
+        if(encoder->index == 0 && captureaudio && CaptureWriteAudio())
+        {
+            idle = false;
+        }
+
+        if(idle)
+        {
+            if(!running)
+            {
+                break;
+            }
+
+            I_Sleep(1);
+        }
+    }
+
+    return 0;
+}
+
+//
+// CaptureGetFrameSlot
+//
+// Hands frames to the encoders in turn, skipping any that are still
+// full. Returns NULL when none has room, in which case the frame is
+// dropped.
+//
+
+static captureframe_t *CaptureGetFrameSlot(int width, int height,
+                                           spscqueue_t **queue)
+{
+    captureframe_t *frame;
+    int size = width * height * 3;
+    int i;
+
+    for(i = 0; i < numencoders; i++)
+    {
+        captureencoder_t *encoder = &encoders[(nextencoder + i) % numencoders];
+
+        if((frame = I_SPSCWriteSlot(&encoder->queue)) == NULL)
+        {
+            continue;
+        }
+
+        if(frame->size < size)
+        {
+            free(frame->buffer);
+
+            if(!(frame->buffer = malloc(size)))
+            {
+                I_Error("CaptureGetFrameSlot: failed to allocate %i bytes", size);
+            }
+
+            frame->size = size;
+        }
+
+        frame->width = width;
+        frame->height = height;
+        frame->flipped = false;
+
+        nextencoder = (nextencoder + i + 1) % numencoders;
+        *queue = &encoder->queue;
+        return frame;
+    }
+
+    capturestats.dropped++;
+    return NULL;
+}
+
+//
+// CaptureSoftwareFrame
+//
+
+static void CaptureSoftwareFrame(int number, const byte *screen,
+                                 const uint32_t *palette)
+{
+    captureframe_t *frame;
+    spscqueue_t *queue;
+    byte *dest;
+    int i;
+
+    if(!(frame = CaptureGetFrameSlot(SCREENWIDTH, SCREENHEIGHT, &queue)))
+    {
+        return;
+    }
+
+    // palette entries hold R, G, B, A in memory order
+    dest = frame->buffer;
+
+    for(i = 0; i < SCREENWIDTH * SCREENHEIGHT; i++)
+    {
+        const byte *color = (const byte *)&palette[screen[i]];
+
+        dest[0] = color[0];
+        dest[1] = color[1];
+        dest[2] = color[2];
+        dest += 3;
+    }
+
+    frame->number = number;
+    I_SPSCCommitWrite(queue);
+    capturestats.frames++;
+}
+
+//
+// CaptureQueueReadback
+//
+// Copies a finished PBO into an encoder ring.
+//
+
+static void CaptureQueueReadback(int slot)
+{
+    captureframe_t *frame;
+    spscqueue_t *queue;
+    byte *pixels;
+
+    dglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, pbos[slot]);
+
+    if((frame = CaptureGetFrameSlot(pbowidth, pboheight, &queue)) != NULL)
+    {
+        pixels = (byte *)dglMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+
+        if(pixels)
+        {
+            memcpy(frame->buffer, pixels, pbowidth * pboheight * 3);
+            dglUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+
+            frame->flipped = true;
+            frame->number = pbonumber[slot];
+            I_SPSCCommitWrite(queue);
+            capturestats.frames++;
+        }
+        else
+        {
+            capturestats.dropped++;
+        }
+    }
+
+    dglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    pbonumber[slot] = -1;
+}
+
+//
+// CaptureFlushReadbacks
+//
+// Collects every read still in flight, oldest first.
+//
+
+static void CaptureFlushReadbacks(void)
+{
+    int slot;
+    int i;
+
+    // nothing to collect before the buffers are first sized
+    if(!usepbo || pbowidth == 0)
+    {
+        return;
+    }
+
+    for(i = 0; i < CAPTURE_PBOS; i++)
+    {
+        slot = (pbocurrent + i) % CAPTURE_PBOS;
+
+        if(pbonumber[slot] >= 0)
+        {
+            CaptureQueueReadback(slot);
+        }
+    }
+}
+
+//
+// CaptureGLFrame
+//
+
+static void CaptureGLFrame(int number)
+{
+    captureframe_t *frame;
+    spscqueue_t *queue;
+    int pack;
+    int i;
+
+    if(!glchecked)
+    {
+        usepbo = has_GL_ARB_vertex_buffer_object &&
+                 GL_CheckExtension("GL_ARB_pixel_buffer_object");
+        glchecked = true;
+
+        if(usepbo)
+        {
+            dglGenBuffersARB(CAPTURE_PBOS, pbos);
+        }
+    }
+
+    dglGetIntegerv(GL_PACK_ALIGNMENT, &pack);
+    dglPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    if(!usepbo)
+    {
+        // no PBOs: a plain synchronous read straight into the ring
+        if((frame = CaptureGetFrameSlot(screen_width, screen_height, &queue)) != NULL)
+        {
+            dglReadPixels(0, 0, screen_width, screen_height, GL_RGB,
+                          GL_UNSIGNED_BYTE, frame->buffer);
+
+            frame->flipped = true;
+            frame->number = number;
+            I_SPSCCommitWrite(queue);
+            capturestats.frames++;
+        }
+
+        dglPixelStorei(GL_PACK_ALIGNMENT, pack);
+        return;
+    }
+
+    // window resized; anything still in flight is the old size, so
+    // collect it before the buffers are reallocated
+    if(pbowidth != screen_width || pboheight != screen_height)
+    {
+        CaptureFlushReadbacks();
+
+        pbowidth = screen_width;
+        pboheight = screen_height;
+
+        for(i = 0; i < CAPTURE_PBOS; i++)
+        {
+            dglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, pbos[i]);
+            dglBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, pbowidth * pboheight * 3,
+                             NULL, GL_STREAM_READ_ARB);
+            pbonumber[i] = -1;
+        }
+
+        pbocurrent = 0;
+    }
+
+    // the oldest read in the ring has had CAPTURE_PBOS - 1 frames to
+    // finish; collect it before reusing its buffer
+    if(pbonumber[pbocurrent] >= 0)
+    {
+        CaptureQueueReadback(pbocurrent);
+    }
+
+    dglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, pbos[pbocurrent]);
+    dglReadPixels(0, 0, pbowidth, pboheight, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    dglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    pbonumber[pbocurrent] = number;
+    pbocurrent = (pbocurrent + 1) % CAPTURE_PBOS;
+
+    dglPixelStorei(GL_PACK_ALIGNMENT, pack);
+}
+
+//
+// I_CaptureFrame
+//
+
+void I_CaptureFrame(const byte *screen, const uint32_t *palette)
+{
+    int now;
+    int number;
+
+    if(!capturestats.active)
+    {
+        return;
+    }
+
+    now = I_GetTimeMS();
+
+    if(capturelast < 0)
+    {
+        capturestart = now;
+    }
+
+    // frame numbers follow the capture clock, so a gap in the sequence
+    // marks a slot the display was too slow to fill
+    number = (int)((int64_t)(now - capturestart) * capturerate / 1000);
+
+    if(number <= capturelast)
+    {
+        return;
+    }
+
+    capturelast = number;
+
+    if(screen)
+    {
+        CaptureSoftwareFrame(number, screen, palette);
+    }
+    else
+    {
+        CaptureGLFrame(number);
+    }
+
+    capturestats.audiodropped = SDL_AtomicGet(&audiodropped);
+}
+
+//
+// I_ShutdownCapture
+//
+
+static void I_ShutdownCapture(void)
+{
+    int freq;
+    int channels;
+    int i;
+    int j;
+
+    if(captureaudio)
+    {
+        Mix_UnregisterEffect(MIX_CHANNEL_POST, CaptureAudioEffect);
+    }
+
+    // the last frames are still in the PBO ring; hand them to the
+    // encoders before telling them to stop
+    CaptureFlushReadbacks();
+
+    SDL_AtomicSet(&capturerunning, 0);
+
+    for(i = 0; i < numencoders; i++)
+    {
+        SDL_WaitThread(encoders[i].thread, NULL);
+
+        for(j = 0; j <= (int)encoders[i].queue.mask; j++)
+        {
+            captureframe_t *frame = (captureframe_t *)
+                (encoders[i].queue.data + j * encoders[i].queue.elemsize);
+
+            free(frame->buffer);
+        }
+
+        I_SPSCFree(&encoders[i].queue);
+    }
+
+    if(captureaudio)
+    {
+        Mix_QuerySpec(&freq, NULL, &channels);
+        CaptureWriteWAVHeader(freq, channels);
+        fclose(wavfile);
+        I_SPSCFree(&audioqueue);
+    }
+
+    printf("I_ShutdownCapture: %i frames captured to %s, %i dropped, "
+           "%i audio chunks dropped\n",
+           capturestats.frames, capturedir, capturestats.dropped,
+           SDL_AtomicGet(&audiodropped));
+
+    capturestats.active = false;
+}
+
+//
+// I_InitCapture
+//
+
+void I_InitCapture(void)
+{
+    char filename[256];
+    Uint16 format;
+    int freq;
+    int channels;
+    int i;
+
+    //!
+    // @arg <directory>
+    // @category video
+    //
+    // Record gameplay to a numbered PNG sequence, plus capture.wav
+    // with the mixer output, in the given directory.
+    //
+
+    i = M_CheckParmWithArgs("-capture", 1);
+
+    if(i <= 0)
+    {
+        return;
+    }
+
+    capturedir = myargv[i + 1];
+    M_MakeDirectory(capturedir);
+
+    //!
+    // @arg <fps>
+    // @category video
+    //
+    // Frame rate used by -capture. The default is 35.
+    //
+
+    i = M_CheckParmWithArgs("-capturerate", 1);
+
+    if(i > 0)
+    {
+        capturerate = MAX(atoi(myargv[i + 1]), 1);
+    }
+
+    SDL_AtomicSet(&capturerunning, 1);
+    SDL_AtomicSet(&audiodropped, 0);
+
+    if(Mix_QuerySpec(&freq, &format, &channels))
+    {
+        if(format == AUDIO_S16LSB)
+        {
+            M_snprintf(filename, sizeof(filename), "%s" DIR_SEPARATOR_S "capture.wav",
+                       capturedir);
+
+            if((wavfile = fopen(filename, "wb")) != NULL)
+            {
+                CaptureWriteWAVHeader(freq, channels);
+                I_SPSCInit(&audioqueue, sizeof(captureaudio_t), CAPTURE_AUDIO_CHUNKS);
+                captureaudio = true;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "I_InitCapture: mixer output is not 16-bit "
+                            "little-endian; audio will not be captured\n");
+        }
+    }
+
+    numencoders = SDL_GetCPUCount() - 1;
+    numencoders = MAX(MIN(numencoders, CAPTURE_MAX_ENCODERS), 1);
+
+    for(i = 0; i < numencoders; i++)
+    {
+        encoders[i].index = i;
+        I_SPSCInit(&encoders[i].queue, sizeof(captureframe_t), CAPTURE_QUEUE_FRAMES);
+        encoders[i].thread = SDL_CreateThread(CaptureEncoderThread, "Capture",
+                                              &encoders[i]);
+
+        if(!encoders[i].thread)
+        {
+            I_Error("I_InitCapture: failed to start encoder thread: %s",
+                    SDL_GetError());
+        }
+    }
+
+    // only tap the mixer once something is draining the ring
+    if(captureaudio)
+    {
+        Mix_RegisterEffect(MIX_CHANNEL_POST, CaptureAudioEffect, NULL, NULL);
+    }
+
+    capturestats.active = true;
+
+    I_AtExit(I_ShutdownCapture, true);
+
+    printf("I_InitCapture: capturing to %s at %i fps with %i encoder thread%s\n",
+           capturedir, capturerate, numencoders, numencoders == 1 ? "" : "s");
+}
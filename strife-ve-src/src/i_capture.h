@@ -0,0 +1,41 @@
+//
+// Copyright(C) 2014 Night Dive Studios, Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//    In-engine gameplay capture to a PNG sequence plus a WAV of the
+//    mixer output, encoded off the game thread.
+//
+
+#ifndef __I_CAPTURE__
+#define __I_CAPTURE__
+
+#include "doomtype.h"
+
+typedef struct
+{
+    boolean active;
+    int     frames;         // frames handed to the encoders
+    int     dropped;        // frames dropped because every queue was full
+    int     audiodropped;   // mixer chunks dropped because the ring was full
+} capturestats_t;
+
+extern capturestats_t capturestats;
+
+// Call once the mixer is open; does nothing unless -capture was given.
+void I_InitCapture(void);
+
+// Grab the frame about to be presented. Pass the software screen and
+// its palette, or NULL to read back the GL back buffer.
+void I_CaptureFrame(const byte *screen, const uint32_t *palette);
+
+#endif
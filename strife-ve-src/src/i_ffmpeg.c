@@ -23,6 +23,8 @@
 #include "i_video.h"
 #include "i_system.h"
 #include "i_joystick.h"
+#include "i_spscqueue.h"
+#include "i_timer.h"
 #include "rb_main.h"
 #include "rb_draw.h"
 #include "rb_texture.h"
@@ -60,6 +62,24 @@
 #define SDL_AUDIO_BUFFER_SIZE       4096
 #define MAX_AUDIO_FRAME_SIZE        192000
 
+//
+// number of converted frames the decode thread may run ahead of the display.
+// frame threading adds one frame of latency per decoder thread, so this only
+// needs to be deep enough to ride out a slow frame or two
+//
+#define VIDEO_FRAME_QUEUE_SIZE      4
+#define MAX_DECODE_THREADS          16
+
+//
+// the packet and audio rings are sized to hold this many seconds of the
+// stream. the demuxer blocks when either one fills up, so this has to cover
+// however far apart the container interleaves its audio and video
+//
+#define AV_QUEUE_SECONDS            4
+#define MIN_PACKET_QUEUE_SIZE       64
+#define MAX_PACKET_QUEUE_SIZE       1024
+#define MIN_AUDIO_QUEUE_SIZE        16
+
 //=============================================================================
 //
 // Structs
@@ -67,38 +87,40 @@
 //=============================================================================
 
 //
-// every video and audio packet that we recieve from the decoder is thrown into a queue
-// which is all done by the thread routine. the drawer and post mix functions are
-// responsible from accessing each entry in the queue
+// every video packet and decoded audio buffer that we recieve from the demuxer
+// is thrown into a ring, which is all done by the thread routine. the decode
+// thread and post mix function are responsible for draining them. each ring
+// has exactly one producer and one consumer so neither side takes a lock, and
+// everything is allocated when the movie is loaded
 //
 
-typedef struct avPacketData_s
+typedef struct
 {
-    AVPacket                    *packet;
-    struct avPacketData_s       *next;
+    AVPacket                    packet;
     boolean                     endMark;
-} avQueuePacketData_t;
+} avQueuePacket_t;
 
 typedef struct
-{
-    avQueuePacketData_t         *first;
-    SDL_mutex                   *mutex;
-} avPacketQueue_t;
-
-typedef struct avAudioQueueData_s
 {
     uint8_t                     buffer[SDL_AUDIO_BUFFER_SIZE];
     int                         size;
     int                         offset;
     double                      timestamp;
-    struct avAudioQueueData_s   *next;
 } avAudioQueueData_t;
 
+//
+// decoded frames are converted to RGB on the decode thread and handed to the
+// main thread through a fixed ring. the pixel buffers are carved out of
+// videoBuffer up front so nothing is allocated during playback
+//
+
 typedef struct
 {
-    avAudioQueueData_t          *first;
-    SDL_mutex                   *mutex;
-} avAudioQueue_t;
+    uint8_t                     *buffer;
+    double                      pts;
+    double                      clock;
+    boolean                     endMark;
+} avVideoFrame_t;
 
 //=============================================================================
 //
@@ -116,16 +138,13 @@ static AVCodecContext       *audioCodecCtx;
 static AVCodec              *videoCodec;
 static AVCodec              *audioCodec;
 
-// global video frame
-static AVFrame              *videoFrame;
-
 // global buffers
 static uint8_t              *videoBuffer;
 static uint8_t              *audioBuffer;
+static int                  videoFrameSize;
 
 // global timestamps
 static int64_t              currentPts;
-static uint64_t             globalPts;
 static double               audioPts;
 
 // dimentions
@@ -139,6 +158,9 @@ static int                  audioStreamIdx;
 // main thread
 static SDL_Thread           *thread;
 
+// video decode thread
+static SDL_Thread           *decodeThread;
+
 // texture to display video
 static rbTexture_t          texture;
 
@@ -157,21 +179,30 @@ static boolean              audioFinished;
 // keep track of holding down the key
 static boolean              userPressed;
 
-// packet queues
-static avPacketQueue_t      *videoPacketQueue;
-static avPacketQueue_t      *audioPacketQueue;
+// demuxer has read the whole file
+static boolean              demuxFinished;
+
+// packet queue
+static spscqueue_t          videoPacketQueue;
+
+// audio buffer queue and the chunk that's still being filled
+static spscqueue_t          audioQueue;
+static avAudioQueueData_t   *audioFillChunk;
 
-// audio buffer queue
-static avAudioQueue_t       audioQueue;
+// decoded frames waiting to be displayed
+static spscqueue_t          videoFrameQueue;
 
 // clock speed
 static double               videoClock;
 static double               audioClock;
+static double               decodeClock;
 
 // length of the frame in time
 static double               frameTime;
 static double               lastFrameTime;
 
+avstats_t avstats;
+
 //=============================================================================
 //
 // Packet Querying
@@ -179,132 +210,107 @@ static double               lastFrameTime;
 //=============================================================================
 
 //
-// I_AVAllocQueuePacketData
+// I_AVUpdateMaxDepth
 //
 
-static avQueuePacketData_t *I_AVAllocQueuePacketData(AVPacket *packet)
+static void I_AVUpdateMaxDepth(spscqueue_t *queue, int *maxdepth)
 {
-    avQueuePacketData_t *packetItem = (avQueuePacketData_t*)malloc(sizeof(avQueuePacketData_t));
+    int depth = (int)I_SPSCCount(queue);
 
-    if(packet)
-    {
-        packetItem->packet = (AVPacket*)malloc(sizeof(AVPacket));
-        memcpy(packetItem->packet, packet, sizeof(AVPacket));
-        packetItem->endMark = false;
-    }
-    else
+    if(depth > *maxdepth)
     {
-        packetItem->packet = NULL;
-        packetItem->endMark = true;
+        *maxdepth = depth;
     }
-
-    packetItem->next = NULL;
-    
-    return packetItem;
-}
-
-//
-// I_AVAllocQueuePacket
-//
-
-static avPacketQueue_t *I_AVAllocQueuePacket(void)
-{
-    avPacketQueue_t *packetQueue = (avPacketQueue_t*)malloc(sizeof(avPacketQueue_t));
-    packetQueue->first = NULL;
-    
-    packetQueue->mutex = SDL_CreateMutex();
-    return packetQueue;
 }
 
 //
 // I_AVPushPacketToQueue
 //
-// Adds a video packet the queue list
+// Hands a video packet to the decode thread, or the end marker
+// if packet is NULL. Waits if the decoder has fallen too far
+// behind. Returns false if the user bailed out while waiting
 // Called from SDL thread
 //
 
-static void I_AVPushPacketToQueue(avPacketQueue_t *packetQueue, AVPacket *packet)
+static boolean I_AVPushPacketToQueue(spscqueue_t *packetQueue, AVPacket *packet)
 {
-    avQueuePacketData_t **ptr;
-    
-    SDL_LockMutex(packetQueue->mutex);
-    ptr = &packetQueue->first;
+    avQueuePacket_t *slot;
     
-    while(*ptr)
+    while((slot = (avQueuePacket_t*)I_SPSCWriteSlot(packetQueue)) == NULL)
+    {
+        if(userExit)
+        {
+            return false;
+        }
+
+        avstats.demuxstalls++;
+        I_Sleep(1);
+    }
+
+    if(packet)
     {
-        ptr = &(*ptr)->next;
+        slot->packet = *packet;
+        slot->endMark = false;
     }
-    
-    *ptr = I_AVAllocQueuePacketData(packet);
-    
-    SDL_UnlockMutex(packetQueue->mutex);
+    else
+    {
+        av_init_packet(&slot->packet);
+        slot->packet.data = NULL;
+        slot->packet.size = 0;
+        slot->endMark = true;
+    }
+
+    I_SPSCCommitWrite(packetQueue);
+    I_AVUpdateMaxDepth(packetQueue, &avstats.maxvideopackets);
+    return true;
 }
 
 //
 // I_AVPopPacketFromQueue
 //
+// Copies out the next packet, which the caller now owns. Returns
+// false if there is nothing to decode, with endMark set if that's
+// because the stream has ended
+//
 
-static boolean I_AVPopPacketFromQueue(avPacketQueue_t *packetQueue, AVPacket **packet)
+static boolean I_AVPopPacketFromQueue(spscqueue_t *packetQueue, AVPacket *packet, boolean *endMark)
 {
-    boolean result = true;
+    avQueuePacket_t *slot;
 
-    *packet = NULL;
+    *endMark = false;
 
-    if(packetQueue->mutex)
+    if(!(slot = (avQueuePacket_t*)I_SPSCReadSlot(packetQueue)))
     {
-        SDL_LockMutex(packetQueue->mutex);
+        return false;
     }
 
-    if(packetQueue->first)
-    {
-        if(!packetQueue->first->endMark)
-        {
-            void *del;
-            
-            *packet = packetQueue->first->packet;
-            del = packetQueue->first;
-            packetQueue->first = packetQueue->first->next;
-            
-            free(del);
-        }
-        else
-        {
-            // needed to indicate that we reached the end
-            result = false;
-        }
-    }
-    
-    if(packetQueue->mutex)
+    if(slot->endMark)
     {
-        SDL_UnlockMutex(packetQueue->mutex);
+        // leave it in place so every later pop sees it too
+        *endMark = true;
+        return false;
     }
 
-    return result;
+    *packet = slot->packet;
+    I_SPSCCommitRead(packetQueue);
+    return true;
 }
 
 //
 // I_AVDeletePacketQueue
 //
 
-static void I_AVDeletePacketQueue(avPacketQueue_t **packetQueue)
+static void I_AVDeletePacketQueue(spscqueue_t *packetQueue)
 {
-    SDL_DestroyMutex((*packetQueue)->mutex);
-    (*packetQueue)->mutex = NULL;
+    AVPacket packet;
+    boolean endMark;
 
-    while(1)
+    while(I_AVPopPacketFromQueue(packetQueue, &packet, &endMark))
     {
-        AVPacket *packet;
-
-        if(!I_AVPopPacketFromQueue(*packetQueue, &packet) || packet == NULL)
-        {
-            break;
-        }
-        
-        av_free_packet(packet);
+        av_free_packet(&packet);
     }
 
-    free(*packetQueue);
-    *packetQueue = NULL;
+    I_SPSCFree(packetQueue);
 }
 
 //=============================================================================
@@ -313,107 +319,86 @@ static void I_AVDeletePacketQueue(avPacketQueue_t **packetQueue)
 //
 //=============================================================================
 
-//
-// I_AVAllocAudioQueueData
-//
-
-static avAudioQueueData_t *I_AVAllocAudioQueueData(uint8_t *buffer, const int size)
-{
-    avAudioQueueData_t *audioData = (avAudioQueueData_t*)malloc(sizeof(avAudioQueueData_t));
-
-    audioData->size = size;
-    audioData->next = NULL;
-    audioData->offset = 0;
-    audioData->timestamp = audioPts;
-
-    memcpy(audioData->buffer, buffer, size);
-    return audioData;
-}
-
 //
 // I_AVPushAudioToQueue
 //
-// Adds a fixed amount of audio buffer to the queue.
-// If the size is less than the max buffer size specified
-// by SDL_AUDIO_BUFFER_SIZE, then the current buffer in
-// the queue will be reused the next time this function
-// is called until it's full
+// Adds a fixed amount of audio buffer to the queue. Chunks are
+// only published once they hold SDL_AUDIO_BUFFER_SIZE bytes;
+// a partially filled one is kept back and topped up the next
+// time this function is called
+// Called from SDL thread
 //
 
 static void I_AVPushAudioToQueue(uint8_t *buffer, const int size)
 {
-    avAudioQueueData_t **ptr;
     int bufsize = size;
     uint8_t *buf = buffer;
     
-    SDL_LockMutex(audioQueue.mutex);
-    ptr = &audioQueue.first;
-    
     while(bufsize > 0)
     {
-        // we'll need to create a new audio queue here
-        if(*ptr == NULL)
+        int len;
+
+        if(audioFillChunk == NULL)
         {
-            // exceeded the buffer limit?
-            if(bufsize > SDL_AUDIO_BUFFER_SIZE)
+            while((audioFillChunk = (avAudioQueueData_t*)I_SPSCWriteSlot(&audioQueue)) == NULL)
             {
-                int remaining = (bufsize - SDL_AUDIO_BUFFER_SIZE);
+                if(userExit)
+                {
+                    return;
+                }
 
-                // copy what we have
-                *ptr = I_AVAllocAudioQueueData(buf, SDL_AUDIO_BUFFER_SIZE);
-                bufsize = remaining;
-                buf += SDL_AUDIO_BUFFER_SIZE;
+                avstats.demuxstalls++;
+                I_Sleep(1);
             }
-            else
-            {
-                *ptr = I_AVAllocAudioQueueData(buf, bufsize);
-                // we don't need to do anything else
-                break;
-            }
-        }
 
-        // buffer not filled?
-        if((*ptr)->size < SDL_AUDIO_BUFFER_SIZE)
-        {
-            int len = bufsize + (*ptr)->size;
+            audioFillChunk->size = 0;
+            audioFillChunk->offset = 0;
+            audioFillChunk->timestamp = audioPts;
+        }
 
-            // exceeded the buffer limit?
-            if(len > SDL_AUDIO_BUFFER_SIZE)
-            {
-                int remaining = (SDL_AUDIO_BUFFER_SIZE - (*ptr)->size);
+        len = MIN(bufsize, SDL_AUDIO_BUFFER_SIZE - audioFillChunk->size);
 
-                // copy what we have
-                memcpy((*ptr)->buffer + (*ptr)->size, buf, remaining);
-                (*ptr)->size = SDL_AUDIO_BUFFER_SIZE;
+        memcpy(audioFillChunk->buffer + audioFillChunk->size, buf, len);
+        audioFillChunk->size += len;
 
-                bufsize -= remaining;
-                buf += remaining;
-            }
-            else
-            {
-                // copy into the existing buffer
-                memcpy((*ptr)->buffer + (*ptr)->size, buf, bufsize);
-                (*ptr)->size += bufsize;
+        bufsize -= len;
+        buf += len;
 
-                // we don't need to do anything else
-                SDL_UnlockMutex(audioQueue.mutex);
-                return;
-            }
+        if(audioFillChunk->size >= SDL_AUDIO_BUFFER_SIZE)
+        {
+            audioFillChunk = NULL;
+            I_SPSCCommitWrite(&audioQueue);
+            I_AVUpdateMaxDepth(&audioQueue, &avstats.maxaudiochunks);
         }
+    }
+}
 
-        ptr = &(*ptr)->next;
+//
+// I_AVFlushAudioQueue
+//
+// Publishes whatever is left in the partially filled chunk
+// Called from SDL thread
+//
+
+static void I_AVFlushAudioQueue(void)
+{
+    if(audioFillChunk == NULL)
+    {
+        return;
     }
-    
-    SDL_UnlockMutex(audioQueue.mutex);
+
+    audioFillChunk = NULL;
+    I_SPSCCommitWrite(&audioQueue);
 }
 
 //
 // I_AVPopAudioFromQueue
 //
 // Retrieves an audio buffer from the queue and gets the
-// timestamp that it's based on. The buffer in the queue
-// won't be freed until the entire buffer has been read
-// which 'filled' will be set to true
+// timestamp that it's based on. The chunk in the queue
+// won't be released until the entire buffer has been read
+// which 'filled' will be set to true. Anything past the
+// end of the final chunk is padded with silence
 //
 // Called from the Post-Mix callback routine
 //
@@ -421,7 +406,8 @@ static void I_AVPushAudioToQueue(uint8_t *buffer, const int size)
 static uint8_t *I_AVPopAudioFromQueue(const int size, double *timestamp, boolean *filled)
 {
     static uint8_t buffer[SDL_AUDIO_BUFFER_SIZE];
-    uint8_t *result = NULL;
+    avAudioQueueData_t *chunk;
+    int len;
     
     if(filled)
     {
@@ -433,57 +419,34 @@ static uint8_t *I_AVPopAudioFromQueue(const int size, double *timestamp, boolean
         *timestamp = 0;
     }
 
-    if(audioQueue.mutex)
+    if(!(chunk = (avAudioQueueData_t*)I_SPSCReadSlot(&audioQueue)))
     {
-        SDL_LockMutex(audioQueue.mutex);
+        return NULL;
     }
 
-    if(audioQueue.first)
-    {
-        void *del;
-
-        memcpy(buffer, audioQueue.first->buffer + audioQueue.first->offset, size);
-        audioQueue.first->offset += size;
-        result = buffer;
+    len = MIN(size, chunk->size - chunk->offset);
 
-        if(timestamp)
-        {
-            *timestamp = audioQueue.first->timestamp;
-        }
+    memcpy(buffer, chunk->buffer + chunk->offset, len);
+    memset(buffer + len, 0, size - len);
+    chunk->offset += len;
 
-        // if the entire buffer was read, then we need to free this queue
-        if(audioQueue.first->offset >= audioQueue.first->size)
-        {
-            del = audioQueue.first;
-            audioQueue.first = audioQueue.first->next;
-        
-            free(del);
-            
-            if(filled)
-            {
-                *filled = true;
-            }
-        }
-    }
-    
-    if(audioQueue.mutex)
+    if(timestamp)
     {
-        SDL_UnlockMutex(audioQueue.mutex);
+        *timestamp = chunk->timestamp;
     }
 
-    return result;
-}
-
-//
-// I_AVDeleteAudioQueue
-//
+    // if the entire buffer was read, then hand the chunk back
+    if(chunk->offset >= chunk->size)
+    {
+        I_SPSCCommitRead(&audioQueue);
 
-static void I_AVDeleteAudioQueue(void)
-{
-    SDL_DestroyMutex(audioQueue.mutex);
-    audioQueue.mutex = NULL;
+        if(filled)
+        {
+            *filled = true;
+        }
+    }
 
-    while(I_AVPopAudioFromQueue(SDL_AUDIO_BUFFER_SIZE, NULL, NULL) != NULL);
+    return buffer;
 }
 
 //=============================================================================
@@ -588,11 +551,14 @@ static void I_AVPostMixCallback(void *udata, uint8_t *stream, int len)
     extern int sfxVolume;
     boolean filled;
     
-    if(!audioPacketQueue || userExit)
+    if(userExit)
     {
         return;
     }
 
+    // the pop buffer is only one chunk long
+    len = MIN(len, SDL_AUDIO_BUFFER_SIZE);
+
     if((buf = I_AVPopAudioFromQueue(len, &timestamp, &filled)))
     {
         int i;
@@ -628,6 +594,11 @@ static void I_AVPostMixCallback(void *udata, uint8_t *stream, int len)
     }
     else
     {
+        if(!demuxFinished)
+        {
+            avstats.audiounderruns++;
+        }
+
         audioFinished = true;
     }
 }
@@ -638,46 +609,11 @@ static void I_AVPostMixCallback(void *udata, uint8_t *stream, int len)
 //
 //=============================================================================
 
-//
-// I_AVYUVToBuffer
-//
-
-static void I_AVYUVToBuffer(AVFrame *frame)
-{
-    int y, u, v;
-    int r, g, b;
-    int px, py;
-    int i;
-    byte *yptr = frame->data[0];
-    byte *uptr = frame->data[1];
-    byte *vptr = frame->data[2];
-    
-    i = 0;
-    
-    for(py = 0; py < reqHeight; py++)
-    {
-        for(px = 0; px < reqWidth; px++, i += 3)
-        {
-            y = yptr[py     * frame->linesize[0] + px    ];
-            u = uptr[py / 2 * frame->linesize[1] + px / 2];
-            v = vptr[py / 2 * frame->linesize[2] + px / 2];
-            
-            r = y + 1.402f   * (v - 128);
-            g = y - 0.34414f * (u - 128) - 0.71414f * (v - 128);
-            b = y + 1.772f   * (u - 128);
-            
-            videoBuffer[i    ] = MAX(MIN(r, 255), 0);
-            videoBuffer[i + 1] = MAX(MIN(g, 255), 0);
-            videoBuffer[i + 2] = MAX(MIN(b, 255), 0);
-        }
-    }
-}
-
 //
 // I_AVUpdateVideoClock
 //
-// Try to sync the video clock with the given timestamp
-// gathered from the frame packet
+// Try to sync the decode clock with the given timestamp
+// gathered from the frame. Called from the decode thread
 //
 
 static double I_AVUpdateVideoClock(AVFrame *frame, double pts)
@@ -686,158 +622,230 @@ static double I_AVUpdateVideoClock(AVFrame *frame, double pts)
 
     if(pts != 0)
     {
-        videoClock = pts;
+        decodeClock = pts;
     }
     else
     {
-        pts = videoClock;
+        pts = decodeClock;
     }
 
     frameDelay = av_q2d(videoCodecCtx->time_base);
     frameDelay += frame->repeat_pict * (frameDelay * 0.5);
 
-    videoClock += frameDelay;
+    decodeClock += frameDelay;
     return pts;
 }
 
 //
-// I_AVProcessNextVideoFrame
+// I_AVGetVideoFrameSlot
+//
+// Waits for room in the frame queue. Returns NULL if the
+// user bailed out while we were waiting
 //
 
-static void I_AVProcessNextVideoFrame(void)
+static avVideoFrame_t *I_AVGetVideoFrameSlot(void)
 {
-    int frameDone = 0;
-    AVFrame *frame;
-    AVPacket *packet;
-    double pts = 0;
-    boolean behind = false;
+    avVideoFrame_t *slot;
 
-    if(hasAudio)
+    while((slot = (avVideoFrame_t*)I_SPSCWriteSlot(&videoFrameQueue)) == NULL)
     {
-        if(videoClock > audioClock || audioClock <= 0)
+        if(userExit)
         {
-            // don't process if the audio clock hasn't started
-            // or if the video clock is ahead though
-            // this shouldn't be needed but just in case....
-            return;
+            return NULL;
         }
+
+        I_Sleep(1);
     }
-    
-    frame = av_frame_alloc();
 
-    if(hasAudio)
+    return slot;
+}
+
+//
+// I_AVQueueVideoFrame
+//
+// Converts a decoded frame straight into the next free
+// buffer of the frame queue and publishes it
+//
+
+static boolean I_AVQueueVideoFrame(AVFrame *frame, const uint64_t frameNum)
+{
+    avVideoFrame_t *slot;
+    uint8_t *dst[4] = { NULL, NULL, NULL, NULL };
+    int dstStride[4] = { 0, 0, 0, 0 };
+    int64_t timestamp;
+    double pts;
+
+    if(!(slot = I_AVGetVideoFrameSlot()))
     {
-        behind = audioFinished ? true : I_AVVideoClockBehind();
+        return false;
     }
 
-    // collect packets until we have a frame
-    while(!frameDone || behind)
+    // the ring hands out slots in order, so the buffer at this
+    // index is never the one the main thread is still reading
+    slot->buffer = videoBuffer +
+        (frameNum & (I_SPSCCapacity(&videoFrameQueue) - 1)) * videoFrameSize;
+    slot->endMark = false;
+
+    // with frame threading the packet that went in is not the one
+    // that came out, so let the decoder tell us the timestamp
+    timestamp = av_frame_get_best_effort_timestamp(frame);
+    pts = (timestamp != AV_NOPTS_VALUE) ? (double)timestamp : 0;
+    pts *= av_q2d(formatCtx->streams[videoStreamIdx]->time_base);
+
+    slot->pts = I_AVUpdateVideoClock(frame, pts);
+    slot->clock = decodeClock;
+
+    // convert the decoded data to color data
+    dst[0] = slot->buffer;
+    dstStride[0] = reqWidth * 3;
+
+    sws_scale(swsCtx,
+              (uint8_t const*const*)frame->data,
+              frame->linesize,
+              0,
+              videoCodecCtx->height,
+              dst,
+              dstStride);
+
+    I_SPSCCommitWrite(&videoFrameQueue);
+    I_AVUpdateMaxDepth(&videoFrameQueue, &avstats.maxvideoframes);
+    return true;
+}
+
+//
+// I_AVDecodeVideoThread
+//
+// Pulls video packets off the queue, decodes them and keeps the
+// frame queue topped up. Once the demuxer runs dry the decoder is
+// flushed so the frames still held by the worker threads come out
+//
+
+static int SDLCALL I_AVDecodeVideoThread(void *param)
+{
+    AVFrame *frame;
+    AVPacket packet;
+    AVPacket flush;
+    avVideoFrame_t *slot;
+    uint64_t frameNum = 0;
+    boolean draining = false;
+    boolean endMark;
+    int frameDone;
+
+    frame = av_frame_alloc();
+
+    av_init_packet(&flush);
+    flush.data = NULL;
+    flush.size = 0;
+
+    while(!userExit)
     {
-        if(!I_AVPopPacketFromQueue(videoPacketQueue, &packet))
-        {
-            videoFinished = true;
-            break;
-        }
-        
-        if(packet == NULL)
+        frameDone = 0;
+
+        if(!draining)
         {
-            break;
-        }
+            if(!I_AVPopPacketFromQueue(&videoPacketQueue, &packet, &endMark))
+            {
+                if(endMark)
+                {
+                    draining = true;
+                }
+                else
+                {
+                    // demuxer hasn't caught up yet
+                    avstats.videounderruns++;
+                    I_Sleep(1);
+                }
 
-        // get presentation timestamp
-        pts = 0;
-        globalPts = packet->pts;
-        
-        avcodec_decode_video2(videoCodecCtx, frame, &frameDone, packet);
+                continue;
+            }
 
-        // get the decompression timestamp from this packet
-        if(packet->dts == AV_NOPTS_VALUE && frame->opaque &&
-            *(uint64_t*)frame->opaque != AV_NOPTS_VALUE)
-        {
-            pts = *(uint64_t*)frame->opaque;
-        }
-        else if(packet->dts != AV_NOPTS_VALUE)
-        {
-            pts = packet->dts;
+            avcodec_decode_video2(videoCodecCtx, frame, &frameDone, &packet);
+            av_free_packet(&packet);
         }
         else
         {
-            pts = 0;
-        }
-
-        // approximate the timestamp
-        pts *= av_q2d(videoCodecCtx->time_base);
+            avcodec_decode_video2(videoCodecCtx, frame, &frameDone, &flush);
 
-        if(frameDone)
-        {
-            // update the video clock and frame time
-            pts = I_AVUpdateVideoClock(frame, pts);
-            frameTime = (pts - lastFrameTime) * 1000.0;
-            lastFrameTime = pts;
-            currentPts = av_gettime();
-            
-            if(hasAudio)
+            if(!frameDone)
             {
-                // need to keep processing if we're behind
-                // some frames may be skipped
-                behind = I_AVVideoClockBehind();
+                break;
             }
         }
 
-        av_free_packet(packet);
+        if(frameDone && !I_AVQueueVideoFrame(frame, frameNum++))
+        {
+            break;
+        }
     }
-    
-    if(frameDone)
-    {
-        // convert the decoded data to color data
-        sws_scale(swsCtx,
-                  (uint8_t const*const*)frame->data,
-                  frame->linesize,
-                  0,
-                  videoCodecCtx->height,
-                  videoFrame->data,
-                  videoFrame->linesize);
-        
-        I_AVYUVToBuffer(frame);
 
-        RB_BindTexture(&texture);
-        RB_UpdateTexture(&texture, videoBuffer);
+    // let the main thread know there's nothing else coming
+    if((slot = I_AVGetVideoFrameSlot()))
+    {
+        slot->buffer = NULL;
+        slot->endMark = true;
+        I_SPSCCommitWrite(&videoFrameQueue);
     }
-    
-    av_free(frame);
-}
 
-//
-// I_AVGetBufferProc
-//
-
-FF_DISABLE_DEPRECATION_WARNINGS
-
-static int I_AVGetBufferProc(struct AVCodecContext *c, AVFrame *pic)
-{
-    int ret = avcodec_default_get_buffer(c, pic);
-    uint64_t *pts = av_malloc(sizeof(uint64_t));
-    *pts = globalPts;
-
-    pic->opaque = pts;
-    return ret;
+    av_frame_free(&frame);
+    return 0;
 }
 
 //
-// I_AVReleaseBufferProc
+// I_AVProcessNextVideoFrame
 //
 
-static void I_AVReleaseBufferProc(struct AVCodecContext *c, AVFrame *pic)
+static void I_AVProcessNextVideoFrame(void)
 {
-    if(pic)
+    avVideoFrame_t *vf;
+    boolean behind;
+
+    if(hasAudio)
     {
-        av_freep(&pic->opaque);
+        if(videoClock > audioClock || audioClock <= 0)
+        {
+            // don't process if the audio clock hasn't started
+            // or if the video clock is ahead though
+            // this shouldn't be needed but just in case....
+            return;
+        }
     }
 
-    avcodec_default_release_buffer(c, pic);
-}
+    while((vf = (avVideoFrame_t*)I_SPSCReadSlot(&videoFrameQueue)) != NULL)
+    {
+        if(vf->endMark)
+        {
+            videoFinished = true;
+            return;
+        }
+
+        // update the video clock and frame time
+        videoClock = vf->clock;
+        frameTime = (vf->pts - lastFrameTime) * 1000.0;
+        lastFrameTime = vf->pts;
+        currentPts = av_gettime();
+
+        behind = false;
+
+        if(hasAudio)
+        {
+            behind = audioFinished ? true : I_AVVideoClockBehind();
+        }
 
-FF_ENABLE_DEPRECATION_WARNINGS
+        // need to keep going if we're behind but only skip
+        // this frame if there's another one ready to replace it
+        if(behind && I_SPSCCount(&videoFrameQueue) > 1)
+        {
+            I_SPSCCommitRead(&videoFrameQueue);
+            continue;
+        }
+
+        RB_BindTexture(&texture);
+        RB_UpdateTexture(&texture, vf->buffer);
+
+        I_SPSCCommitRead(&videoFrameQueue);
+        break;
+    }
+}
 
 //=============================================================================
 //
@@ -869,6 +877,15 @@ static boolean I_AVSetupCodecContext(AVCodecContext **context, AVCodec **codec,
         return false;
     }
 
+    if((*context)->codec_type == AVMEDIA_TYPE_VIDEO)
+    {
+        // spread decoding across the cpu cores. frame threading is
+        // where most of the win is, slice threading picks up codecs
+        // that can't do it
+        (*context)->thread_count = MAX(MIN(SDL_GetCPUCount(), MAX_DECODE_THREADS), 1);
+        (*context)->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    }
+
     // try to open codec
     if(avcodec_open2(*context, *codec, NULL) < 0)
     {
@@ -886,25 +903,22 @@ static boolean I_AVSetupCodecContext(AVCodecContext **context, AVCodec **codec,
 static boolean I_AVLoadVideo(const char *filename)
 {
     int i;
-    int videoSize;
     int audioSize;
+    double rate;
     char *filepath;
     
-    // setup packet queues
-    videoPacketQueue = I_AVAllocQueuePacket();
-    audioPacketQueue = I_AVAllocQueuePacket();
-
-    // setup audio queue
-    audioQueue.mutex = SDL_CreateMutex();
-    audioQueue.first = NULL;
-    
     userExit = false;
     videoFinished = false;
     audioFinished = false;
+    demuxFinished = false;
+    audioFillChunk = NULL;
+
+    memset(&avstats, 0, sizeof(avstats));
 
     audioPts = 0;
     videoClock = 0;
     audioClock = 0;
+    decodeClock = 0;
 
     // not exactly looking for a wad, but this function makes
     // it easier to find our movie file
@@ -978,38 +992,61 @@ static boolean I_AVLoadVideo(const char *filename)
     texture.width = texture.origwidth;
     texture.height = texture.origheight;
 
-FF_DISABLE_DEPRECATION_WARNINGS
-    videoCodecCtx->get_buffer = I_AVGetBufferProc;
-    videoCodecCtx->release_buffer = I_AVReleaseBufferProc;
-FF_ENABLE_DEPRECATION_WARNINGS
-    
-    videoFrame = av_frame_alloc();
+    // size the packet queue from the frame rate, assuming
+    // the usual one packet per frame
+    rate = av_q2d(formatCtx->streams[videoStreamIdx]->avg_frame_rate);
 
-    videoSize = avpicture_get_size(AV_PIX_FMT_YUV444P, reqWidth, reqHeight);
+    if(rate <= 0 && videoCodecCtx->time_base.num > 0)
+    {
+        rate = 1.0 / av_q2d(videoCodecCtx->time_base);
+    }
+
+    rate = MIN(rate * AV_QUEUE_SECONDS, MAX_PACKET_QUEUE_SIZE);
+
+    I_SPSCInit(&videoPacketQueue, sizeof(avQueuePacket_t),
+               MAX((int)rate, MIN_PACKET_QUEUE_SIZE));
+
+    // and the audio queue from the rate of the 16-bit
+    // interleaved samples that I_AVFillAudioBuffer produces
+    rate = (double)audioCodecCtx->sample_rate * audioCodecCtx->channels * sizeof(int16_t);
+
+    I_SPSCInit(&audioQueue, sizeof(avAudioQueueData_t),
+               MAX((int)(rate * AV_QUEUE_SECONDS / SDL_AUDIO_BUFFER_SIZE), MIN_AUDIO_QUEUE_SIZE));
+
+    // setup the decoded frame queue. every slot gets its own
+    // RGB buffer so the decode thread never waits on the upload
+    I_SPSCInit(&videoFrameQueue, sizeof(avVideoFrame_t), VIDEO_FRAME_QUEUE_SIZE);
+
+    videoFrameSize = reqWidth * reqHeight * 3;
     audioSize = MAX_AUDIO_FRAME_SIZE + FF_INPUT_BUFFER_PADDING_SIZE;
 
-    videoBuffer = (uint8_t*)av_calloc(1, videoSize * sizeof(uint8_t));
+    videoBuffer = (uint8_t*)av_calloc(I_SPSCCapacity(&videoFrameQueue), videoFrameSize * sizeof(uint8_t));
     audioBuffer = (uint8_t*)av_calloc(1, audioSize * sizeof(uint8_t));
 
     RB_UploadTexture(&texture, videoBuffer, TC_CLAMP, TF_LINEAR);
     
+    // let swscale go directly from the decoder's planar format to RGB.
+    // the sizes match so it takes the unscaled path, which has
+    // SIMD converters for the common YUV formats
     swsCtx = sws_getContext(videoCodecCtx->width,
                             videoCodecCtx->height,
                             videoCodecCtx->pix_fmt,
                             reqWidth,
                             reqHeight,
-                            AV_PIX_FMT_YUV444P,
+                            AV_PIX_FMT_RGB24,
                             SWS_BICUBIC,
                             NULL, NULL, NULL);
-    
-    // assign appropriate parts of buffer to image planes in videoFrame
-    // Note that videoFrame is an AVFrame, but AVFrame is a superset
-    // of AVPicture
-    avpicture_fill((AVPicture*)videoFrame,
-                   videoBuffer,
-                   AV_PIX_FMT_YUV444P,
-                   reqWidth,
-                   reqHeight);
+
+    // the movies were authored against a full range BT.601
+    // conversion, so keep them looking the way they always have
+    sws_setColorspaceDetails(swsCtx,
+                             sws_getCoefficients(SWS_CS_ITU601),
+                             1,
+                             sws_getCoefficients(SWS_CS_ITU601),
+                             1,
+                             0,
+                             1 << 16,
+                             1 << 16);
     
     currentPts = av_gettime();
     frameTime = 1000.0 / av_q2d(videoCodecCtx->framerate);
@@ -1035,14 +1072,16 @@ static void I_AVShutdown(void)
     }
 
     SDL_WaitThread(thread, NULL);
+    SDL_WaitThread(decodeThread, NULL);
+
+    avstats.playing = false;
 
     I_AVDeletePacketQueue(&videoPacketQueue);
-    I_AVDeletePacketQueue(&audioPacketQueue);
-    I_AVDeleteAudioQueue();
+    I_SPSCFree(&audioQueue);
+    I_SPSCFree(&videoFrameQueue);
 
     av_free(videoBuffer);
     av_free(audioBuffer);
-    av_free(videoFrame);
     
     avcodec_close(videoCodecCtx);
     avcodec_close(audioCodecCtx);
@@ -1116,7 +1155,10 @@ static int SDLCALL I_AVIteratePacketsThread(void *param)
         if(packet.stream_index == videoStreamIdx)
         {
             // queue the video packet
-            I_AVPushPacketToQueue(videoPacketQueue, &packet);
+            if(!I_AVPushPacketToQueue(&videoPacketQueue, &packet))
+            {
+                av_free_packet(&packet);
+            }
         }
         else if(hasAudio && packet.stream_index == audioStreamIdx)
         {
@@ -1134,8 +1176,10 @@ static int SDLCALL I_AVIteratePacketsThread(void *param)
     }
 
     // add end markers
-    I_AVPushPacketToQueue(videoPacketQueue, NULL);
-    I_AVPushPacketToQueue(audioPacketQueue, NULL);
+    I_AVPushPacketToQueue(&videoPacketQueue, NULL);
+    I_AVFlushAudioQueue();
+
+    demuxFinished = true;
     return 0;
 }
 
@@ -1170,15 +1214,16 @@ void I_AVStartVideoStream(const char *filename)
         }
     }
 
-    globalPts = AV_NOPTS_VALUE;
-    
     if(!I_AVLoadVideo(filename))
     {
         // can't find or load the video... oh well..
         return;
     }
     
+    avstats.playing = true;
+
 	thread = SDL_CreateThread(I_AVIteratePacketsThread, "I_AV", NULL);
+    decodeThread = SDL_CreateThread(I_AVDecodeVideoThread, "I_AVDecode", NULL);
 
     I_SetShowCursor(false);
 
@@ -16,6 +16,21 @@
 #ifndef __I__FFMPEG_H__
 #define __I__FFMPEG_H__
 
+// [SVE]: movie playback queue statistics
+
+typedef struct
+{
+    int playing;                // a movie is currently streaming
+    int maxvideopackets;        // high water mark of the packet queue
+    int maxaudiochunks;         // high water mark of the audio queue
+    int maxvideoframes;         // high water mark of the decoded frame queue
+    int videounderruns;         // decode thread found no packets waiting
+    int audiounderruns;         // mixer found no audio before end of stream
+    int demuxstalls;            // demuxer waited on a full queue
+} avstats_t;
+
+extern avstats_t avstats;
+
 void I_AVStartVideoStream(const char *filename);
 
 #endif
@@ -89,7 +89,7 @@ static int window_w, window_h;
 
 // The texture that "receives" the original 320x200 screen contents:
 static GLuint unscaled_texture;
-static unsigned int *unscaled_data = NULL;
+static uint32_t *unscaled_data = NULL;
 
 // The scaled framebuffer
 static rbfbo_t scaled_framebuffer;
@@ -201,7 +201,7 @@ static boolean CreateTextures(void)
     // Unscaled texture for input:
     if (unscaled_data == NULL)
     {
-        unscaled_data = malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(int));
+        unscaled_data = malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(*unscaled_data));
     }
     
     if (unscaled_texture == 0)
@@ -213,6 +213,10 @@ static boolean CreateTextures(void)
     dglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     dglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
+    // Allocate the storage once; each frame only replaces the contents.
+    dglTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCREENWIDTH, SCREENHEIGHT, 0,
+                  GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
     return true;
 }
 
@@ -226,27 +230,20 @@ static boolean SetupFramebuffer(void)
 }
 
 // Import screen data from the given pointer and palette and update
-// the unscaled_texture texture.
-static void SetInputData(byte *screen, SDL_Color *palette)
+// the unscaled_texture texture. The palette entries are already laid
+// out as RGBA bytes, so each pixel is a single lookup and store.
+static void SetInputData(byte *screen, const uint32_t *palette)
 {
-    SDL_Color *c;
-    byte *s;
     unsigned int i;
 
-    // TODO: Maybe support GL_RGB as well as GL_RGBA?
-    s = (byte *) unscaled_data;
     for (i = 0; i < SCREENWIDTH * SCREENHEIGHT; ++i)
     {
-		c = &palette[screen[i]];
-        *s++ = c->r;
-        *s++ = c->g;
-        *s++ = c->b;
-        *s++ = 0xff;
+        unscaled_data[i] = palette[screen[i]];
     }
 
     dglBindTexture(GL_TEXTURE_2D, unscaled_texture);
-    dglTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCREENWIDTH, SCREENHEIGHT, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, unscaled_data);
+    dglTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SCREENWIDTH, SCREENHEIGHT,
+                     GL_RGBA, GL_UNSIGNED_BYTE, unscaled_data);
 }
 
 // Draw fake scanlines.
@@ -354,7 +351,7 @@ boolean I_GL_InitScale(int w, int h)
     return true;
 }
 
-void I_GL_UpdateScreen(byte *screendata, SDL_Color *palette)
+void I_GL_UpdateScreen(byte *screendata, const uint32_t *palette)
 {
     // disable culling
     RB_SetState(GLSTATE_CULL, false);
@@ -25,7 +25,7 @@
 #define I_GLSCALE_H
 
 boolean I_GL_InitScale(int w, int h);
-void I_GL_UpdateScreen(byte *screendata, SDL_Color *palette);
+void I_GL_UpdateScreen(byte *screendata, const uint32_t *palette);
 
 extern int gl_max_scale;
 
@@ -102,10 +102,6 @@ typedef struct
     // Data for each channel.
 
     opl_channel_data_t channels[MIDI_CHANNELS_PER_TRACK];
-
-    // Track iterator used to read new events.
-
-    midi_track_iter_t *iter;
 } opl_track_data_t;
 
 typedef struct opl_voice_s opl_voice_t;
@@ -319,13 +315,14 @@ static opl_voice_t *voice_alloced_list;
 
 static opl_track_data_t *tracks;
 static unsigned int num_tracks = 0;
-static unsigned int running_tracks = 0;
 static boolean song_looping;
 
-// Tempo control variables
+// Flattened song being played, the next event to play from it, and
+// the time of the last events that were played.
 
-static unsigned int ticks_per_beat;
-static unsigned int us_per_beat;
+static midi_song_t *current_song;
+static unsigned int song_position;
+static uint64_t song_time;
 
 // Mini-log of recently played percussion instruments:
 
@@ -607,7 +604,7 @@ static void VoiceKeyOff(opl_voice_t *voice)
 
 // Get the frequency that we should be using for a voice.
 
-static void KeyOffEvent(opl_track_data_t *track, midi_event_t *event)
+static void KeyOffEvent(opl_track_data_t *track, midi_song_event_t *event)
 {
     opl_channel_data_t *channel;
     unsigned int key;
@@ -615,13 +612,13 @@ static void KeyOffEvent(opl_track_data_t *track, midi_event_t *event)
 
 /*
     printf("note off: channel %i, %i, %i\n",
-           event->data.channel.channel,
-           event->data.channel.param1,
-           event->data.channel.param2);
+           event->channel,
+           event->param1,
+           event->param2);
 */
 
-    channel = &track->channels[event->data.channel.channel];
-    key = event->data.channel.param1;
+    channel = &track->channels[event->channel];
+    key = event->param1;
 
     // Turn off voices being used to play this key.
     // If it is a double voice instrument there will be two.
@@ -870,7 +867,7 @@ static void VoiceKeyOn(opl_channel_data_t *channel,
     UpdateVoiceFrequency(voice);
 }
 
-static void KeyOnEvent(opl_track_data_t *track, midi_event_t *event)
+static void KeyOnEvent(opl_track_data_t *track, midi_song_event_t *event)
 {
     genmidi_instr_t *instrument;
     opl_channel_data_t *channel;
@@ -879,13 +876,13 @@ static void KeyOnEvent(opl_track_data_t *track, midi_event_t *event)
 
 /*
     printf("note on: channel %i, %i, %i\n",
-           event->data.channel.channel,
-           event->data.channel.param1,
-           event->data.channel.param2);
+           event->channel,
+           event->param1,
+           event->param2);
 */
 
-    key = event->data.channel.param1;
-    volume = event->data.channel.param2;
+    key = event->param1;
+    volume = event->param2;
 
     // A volume of zero means key off. Some MIDI tracks, eg. the ones
     // in AV.wad, use a second key on with a volume of zero to mean
@@ -897,11 +894,11 @@ static void KeyOnEvent(opl_track_data_t *track, midi_event_t *event)
     }
 
     // The channel.
-    channel = &track->channels[event->data.channel.channel];
+    channel = &track->channels[event->channel];
 
     // Percussion channel (10) is treated differently.
 
-    if (event->data.channel.channel == 9)
+    if (event->channel == 9)
     {
         if (key < 35 || key > 81)
         {
@@ -929,15 +926,15 @@ static void KeyOnEvent(opl_track_data_t *track, midi_event_t *event)
     }
 }
 
-static void ProgramChangeEvent(opl_track_data_t *track, midi_event_t *event)
+static void ProgramChangeEvent(opl_track_data_t *track, midi_song_event_t *event)
 {
     int channel;
     int instrument;
 
     // Set the instrument used on this channel.
 
-    channel = event->data.channel.channel;
-    instrument = event->data.channel.param1;
+    channel = event->channel;
+    instrument = event->param1;
     track->channels[channel].instrument = &main_instrs[instrument];
 
     // TODO: Look through existing voices that are turned on on this
@@ -961,7 +958,7 @@ static void SetChannelVolume(opl_channel_data_t *channel, unsigned int volume)
     }
 }
 
-static void ControllerEvent(opl_track_data_t *track, midi_event_t *event)
+static void ControllerEvent(opl_track_data_t *track, midi_song_event_t *event)
 {
     unsigned int controller;
     unsigned int param;
@@ -969,14 +966,14 @@ static void ControllerEvent(opl_track_data_t *track, midi_event_t *event)
 
 /*
     printf("change controller: channel %i, %i, %i\n",
-           event->data.channel.channel,
-           event->data.channel.param1,
-           event->data.channel.param2);
+           event->channel,
+           event->param1,
+           event->param2);
 */
 
-    channel = &track->channels[event->data.channel.channel];
-    controller = event->data.channel.param1;
-    param = event->data.channel.param2;
+    channel = &track->channels[event->channel];
+    controller = event->param1;
+    param = event->param2;
 
     switch (controller)
     {
@@ -994,7 +991,7 @@ static void ControllerEvent(opl_track_data_t *track, midi_event_t *event)
 
 // Process a pitch bend event.
 
-static void PitchBendEvent(opl_track_data_t *track, midi_event_t *event)
+static void PitchBendEvent(opl_track_data_t *track, midi_song_event_t *event)
 {
     opl_channel_data_t *channel;
     unsigned int i;
@@ -1002,8 +999,8 @@ static void PitchBendEvent(opl_track_data_t *track, midi_event_t *event)
     // Update the channel bend value.  Only the MSB of the pitch bend
     // value is considered: this is what Doom does.
 
-    channel = &track->channels[event->data.channel.channel];
-    channel->bend = event->data.channel.param2 - 64;
+    channel = &track->channels[event->channel];
+    channel->bend = event->param2 - 64;
 
     // Update all voices for this channel.
 
@@ -1016,59 +1013,9 @@ static void PitchBendEvent(opl_track_data_t *track, midi_event_t *event)
     }
 }
 
-static void MetaSetTempo(unsigned int tempo)
-{
-    OPL_AdjustCallbacks((float) us_per_beat / tempo);
-    us_per_beat = tempo;
-}
-
-// Process a meta event.
-
-static void MetaEvent(opl_track_data_t *track, midi_event_t *event)
-{
-    byte *data = event->data.meta.data;
-    unsigned int data_len = event->data.meta.length;
-
-    switch (event->data.meta.type)
-    {
-        // Things we can just ignore.
-
-        case MIDI_META_SEQUENCE_NUMBER:
-        case MIDI_META_TEXT:
-        case MIDI_META_COPYRIGHT:
-        case MIDI_META_TRACK_NAME:
-        case MIDI_META_INSTR_NAME:
-        case MIDI_META_LYRICS:
-        case MIDI_META_MARKER:
-        case MIDI_META_CUE_POINT:
-        case MIDI_META_SEQUENCER_SPECIFIC:
-            break;
-
-        case MIDI_META_SET_TEMPO:
-            if (data_len == 3)
-            {
-                MetaSetTempo((data[0] << 16) | (data[1] << 8) | data[2]);
-            }
-            break;
-
-        // End of track - actually handled when we run out of events
-        // in the track, see below.
-
-        case MIDI_META_END_OF_TRACK:
-            break;
-
-        default:
-#ifdef OPL_MIDI_DEBUG
-            fprintf(stderr, "Unknown MIDI meta event type: %i\n",
-                            event->data.meta.type);
-#endif
-            break;
-    }
-}
-
 // Process a MIDI event from a track.
 
-static void ProcessEvent(opl_track_data_t *track, midi_event_t *event)
+static void ProcessEvent(opl_track_data_t *track, midi_song_event_t *event)
 {
     switch (event->event_type)
     {
@@ -1092,14 +1039,12 @@ static void ProcessEvent(opl_track_data_t *track, midi_event_t *event)
             PitchBendEvent(track, event);
             break;
 
-        case MIDI_EVENT_META:
-            MetaEvent(track, event);
-            break;
-
-        // SysEx events can be ignored.
+        // End of track - the song ends when we run out of events,
+        // see below. Tempo changes are already resolved into the
+        // event times, and other meta/SysEx events are dropped when
+        // the song is built.
 
-        case MIDI_EVENT_SYSEX:
-        case MIDI_EVENT_SYSEX_SPLIT:
+        case MIDI_EVENT_META:
             break;
 
         default:
@@ -1110,47 +1055,63 @@ static void ProcessEvent(opl_track_data_t *track, midi_event_t *event)
     }
 }
 
-static void ScheduleTrack(opl_track_data_t *track);
+static void ScheduleNextEvent(void);
 
 // Restart a song from the beginning.
 
 static void RestartSong(void *unused)
 {
-    unsigned int i;
-
-    running_tracks = num_tracks;
-
-    for (i=0; i<num_tracks; ++i)
+    if (current_song == NULL)
     {
-        MIDI_RestartIterator(tracks[i].iter);
-        ScheduleTrack(&tracks[i]);
+        return;
     }
+
+    song_position = 0;
+    song_time = 0;
+
+    ScheduleNextEvent();
 }
 
-// Callback function invoked when another event needs to be read from
-// a track.
+// Callback function invoked when the next events in the song are due.
 
-static void TrackTimerCallback(void *arg)
+static void SongTimerCallback(void *unused)
 {
-    opl_track_data_t *track = arg;
-    midi_event_t *event;
-
-    // Get the next event and process it.
+    midi_song_event_t *event;
+    uint64_t now;
 
-    if (!MIDI_GetNextEvent(track->iter, &event))
+    if (current_song == NULL || song_position >= current_song->num_events)
     {
         return;
     }
 
-    ProcessEvent(track, event);
+    // Process every event due at this time.
 
-    // End of track?
+    now = current_song->events[song_position].time;
 
-    if (event->event_type == MIDI_EVENT_META
-     && event->data.meta.type == MIDI_META_END_OF_TRACK)
+    while (song_position < current_song->num_events)
     {
-        --running_tracks;
+        event = &current_song->events[song_position];
+
+        if (event->time != now)
+        {
+            break;
+        }
+
+        ProcessEvent(&tracks[event->track], event);
+        ++song_position;
+    }
+
+    song_time = now;
+
+    ScheduleNextEvent();
+}
 
+static void ScheduleNextEvent(void)
+{
+    // End of song?
+
+    if (song_position >= current_song->num_events)
+    {
         // When all tracks have finished, restart the song.
         // Don't restart the song immediately, but wait for 5ms
         // before triggering a restart.  Otherwise it is possible
@@ -1158,7 +1119,7 @@ static void TrackTimerCallback(void *arg)
         // to lock up in an infinite loop. (5ms should be short
         // enough not to be noticeable by the listener).
 
-        if (running_tracks <= 0 && song_looping)
+        if (song_looping)
         {
             OPL_SetCallback(5000, RestartSong, NULL);
         }
@@ -1166,26 +1127,11 @@ static void TrackTimerCallback(void *arg)
         return;
     }
 
-    // Reschedule the callback for the next event in the track.
-
-    ScheduleTrack(track);
-}
-
-static void ScheduleTrack(opl_track_data_t *track)
-{
-    unsigned int nticks;
-    uint64_t us;
-
-    // Get the number of microseconds until the next event.
-
-    nticks = MIDI_GetDeltaTime(track->iter);
-    us = ((uint64_t) nticks * us_per_beat * TEMPO_FUDGE_FACTOR)
-       / ticks_per_beat;
-
     // Set a timer to be invoked when the next event is
     // ready to play.
 
-    OPL_SetCallback(us, TrackTimerCallback, track);
+    OPL_SetCallback(current_song->events[song_position].time - song_time,
+                    SongTimerCallback, NULL);
 }
 
 // Initialize a channel.
@@ -1199,59 +1145,42 @@ static void InitChannel(opl_track_data_t *track, opl_channel_data_t *channel)
     channel->bend = 0;
 }
 
-// Start a MIDI track playing:
-
-static void StartTrack(midi_file_t *file, unsigned int track_num)
-{
-    opl_track_data_t *track;
-    unsigned int i;
-
-    track = &tracks[track_num];
-    track->iter = MIDI_IterateTrack(file, track_num);
-
-    for (i=0; i<MIDI_CHANNELS_PER_TRACK; ++i)
-    {
-        InitChannel(track, &track->channels[i]);
-    }
-
-    // Schedule the first event.
-
-    ScheduleTrack(track);
-}
-
 // Start playing a mid
 
 static void I_OPL_PlaySong(void *handle, boolean looping)
 {
-    midi_file_t *file;
-    unsigned int i;
+    midi_song_t *song;
+    unsigned int i, j;
 
     if (!music_initialized || handle == NULL)
     {
         return;
     }
 
-    file = handle;
+    song = handle;
 
     // Allocate track data.
 
-    tracks = malloc(MIDI_NumTracks(file) * sizeof(opl_track_data_t));
+    tracks = malloc(song->num_tracks * sizeof(opl_track_data_t));
 
-    num_tracks = MIDI_NumTracks(file);
-    running_tracks = num_tracks;
+    num_tracks = song->num_tracks;
     song_looping = looping;
 
-    ticks_per_beat = MIDI_GetFileTimeDivision(file);
-
-    // Default is 120 bpm.
-    // TODO: this is wrong
-
-    us_per_beat = 500 * 1000;
-
     for (i=0; i<num_tracks; ++i)
     {
-        StartTrack(file, i);
+        for (j=0; j<MIDI_CHANNELS_PER_TRACK; ++j)
+        {
+            InitChannel(&tracks[i], &tracks[i].channels[j]);
+        }
     }
+
+    current_song = song;
+    song_position = 0;
+    song_time = 0;
+
+    // Schedule the first event.
+
+    ScheduleNextEvent();
 }
 
 static void I_OPL_PauseSong(void)
@@ -1318,15 +1247,11 @@ static void I_OPL_StopSong(void)
 
     // Free all track data.
 
-    for (i=0; i<num_tracks; ++i)
-    {
-        MIDI_FreeIterator(tracks[i].iter);
-    }
-
     free(tracks);
 
     tracks = NULL;
     num_tracks = 0;
+    current_song = NULL;
 
     OPL_Unlock();
 }
@@ -1340,7 +1265,7 @@ static void I_OPL_UnRegisterSong(void *handle)
 
     if (handle != NULL)
     {
-        MIDI_FreeFile(handle);
+        MIDI_FreeSong(handle);
     }
 }
 
@@ -1351,24 +1276,24 @@ static boolean IsMid(byte *mem, int len)
     return len > 4 && !memcmp(mem, "MThd", 4);
 }
 
-static boolean ConvertMus(byte *musdata, int len, char *filename)
+// Convert a MUS lump to a MIDI file in memory and load it.
+
+static midi_file_t *ConvertMus(byte *musdata, int len)
 {
     MEMFILE *instream;
     MEMFILE *outstream;
     void *outbuf;
     size_t outbuf_len;
-    int result;
+    midi_file_t *result = NULL;
 
     instream = mem_fopen_read(musdata, len);
     outstream = mem_fopen_write();
 
-    result = mus2mid(instream, outstream);
-
-    if (result == 0)
+    if (mus2mid(instream, outstream) == 0)
     {
         mem_get_buf(outstream, &outbuf, &outbuf_len);
 
-        M_WriteFile(filename, outbuf, outbuf_len);
+        result = MIDI_LoadFileFromMem(outbuf, outbuf_len);
     }
 
     mem_fclose(instream);
@@ -1379,8 +1304,8 @@ static boolean ConvertMus(byte *musdata, int len, char *filename)
 
 static void *I_OPL_RegisterSong(void *data, int len)
 {
-    midi_file_t *result;
-    char *filename;
+    midi_file_t *file;
+    midi_song_t *result = NULL;
 
     if (!music_initialized)
     {
@@ -1390,31 +1315,31 @@ static void *I_OPL_RegisterSong(void *data, int len)
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
-
     if (IsMid(data, len) && len < MAXMIDLENGTH)
     {
-        M_WriteFile(filename, data, len);
+        file = MIDI_LoadFileFromMem(data, len);
     }
     else
     {
 	// Assume a MUS file and try to convert
 
-        ConvertMus(data, len, filename);
+        file = ConvertMus(data, len);
     }
 
-    result = MIDI_LoadFile(filename);
+    // Flatten the tracks into a single timed event list for the
+    // sequencer; the parsed file is not needed after that.
+
+    if (file != NULL)
+    {
+        result = MIDI_BuildSong(file, TEMPO_FUDGE_FACTOR);
+        MIDI_FreeFile(file);
+    }
 
     if (result == NULL)
     {
         fprintf(stderr, "I_OPL_RegisterSong: Failed to load MID.\n");
     }
 
-    // remove file now
-
-    remove(filename);
-    free(filename);
-
     return result;
 }
 
@@ -1455,6 +1380,7 @@ static void I_OPL_ShutdownMusic(void)
 static boolean I_OPL_InitMusic(void)
 {
     OPL_SetSampleRate(snd_samplerate);
+    OPL_SetMaxSliceTime(snd_maxslicetime_ms);
 
     if (!OPL_Init(opl_io_port))
     {
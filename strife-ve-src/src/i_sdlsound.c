@@ -61,6 +61,13 @@ static boolean sound_initialized = false;
 
 static sfxinfo_t *channels_playing[NUM_CHANNELS];
 
+// Mixer callback timing, used to measure jitter.
+
+static Uint64 last_callback_time;
+static boolean jitter_reported;
+
+audiostats_t audiostats;
+
 static int mixer_freq;
 static Uint16 mixer_format;
 static int mixer_channels;
@@ -297,6 +304,54 @@ static void ReleaseSoundOnChannel(int channel)
     UnlockAllocatedSound(sfxinfo->driver_data);
 }
 
+static void SetChannelPanning(int channel, int left, int right)
+{
+    // SDL_mixer version 1.2.8 and earlier has a bug in the Mix_SetPanning
+    // function.  A workaround is to call Mix_UnregisterAllEffects for
+    // the channel before calling it.  This is undesirable as it may lead
+    // to the channel volumes resetting briefly.
+
+    if (setpanning_workaround)
+    {
+        Mix_UnregisterAllEffects(channel);
+    }
+
+    Mix_SetPanning(channel, left, right);
+}
+
+// [SVE]: Post-mix effect running on the mixer thread. Measures how far
+// the interval between mixer callbacks strays from the nominal slice
+// length; sounds themselves are started and stopped by the game thread.
+
+static void MeasureCallbackTiming(int chan, void *stream, int len, void *udata)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    int period_us;
+    int interval_us;
+    int jitter_us;
+
+    period_us = (int) (((Uint64) (len / 4) * 1000000) / mixer_freq);
+    audiostats.slice_us = period_us;
+    ++audiostats.callbacks;
+
+    if (last_callback_time != 0)
+    {
+        interval_us = (int) (((now - last_callback_time) * 1000000)
+                           / SDL_GetPerformanceFrequency());
+        jitter_us = abs(interval_us - period_us);
+
+        // exponential moving average, 1/16 weight for the new sample
+        audiostats.avgjitter_us += (jitter_us - audiostats.avgjitter_us) / 16;
+
+        if (jitter_us > audiostats.maxjitter_us)
+        {
+            audiostats.maxjitter_us = jitter_us;
+        }
+    }
+
+    last_callback_time = now;
+}
+
 #ifdef HAVE_LIBSAMPLERATE
 
 // Returns the conversion mode for libsamplerate to use.
@@ -814,6 +869,17 @@ static int I_SDL_GetSfxLumpNum(sfxinfo_t *sfx)
     return W_GetNumForName(namebuf);
 }
 
+static void GetPanning(int vol, int sep, int *left, int *right)
+{
+    *left = ((254 - sep) * vol) / 127;
+    *right = ((sep) * vol) / 127;
+
+    if (*left < 0) *left = 0;
+    else if (*left > 255) *left = 255;
+    if (*right < 0) *right = 0;
+    else if (*right > 255) *right = 255;
+}
+
 static void I_SDL_UpdateSoundParams(int handle, int vol, int sep)
 {
     int left, right;
@@ -823,25 +889,8 @@ static void I_SDL_UpdateSoundParams(int handle, int vol, int sep)
         return;
     }
 
-    left = ((254 - sep) * vol) / 127;
-    right = ((sep) * vol) / 127;
-
-    if (left < 0) left = 0;
-    else if ( left > 255) left = 255;
-    if (right < 0) right = 0;
-    else if (right > 255) right = 255;
-
-    // SDL_mixer version 1.2.8 and earlier has a bug in the Mix_SetPanning
-    // function.  A workaround is to call Mix_UnregisterAllEffects for
-    // the channel before calling it.  This is undesirable as it may lead
-    // to the channel volumes resetting briefly.
-
-    if (setpanning_workaround)
-    {
-        Mix_UnregisterAllEffects(handle);
-    }
-
-    Mix_SetPanning(handle, left, right);
+    GetPanning(vol, sep, &left, &right);
+    SetChannelPanning(handle, left, right);
 }
 
 //
@@ -860,17 +909,13 @@ static void I_SDL_UpdateSoundParams(int handle, int vol, int sep)
 static int I_SDL_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep)
 {
     allocated_sound_t *snd;
+    int left, right;
 
     if (!sound_initialized || channel < 0 || channel >= NUM_CHANNELS)
     {
         return -1;
     }
 
-    // Release a sound effect if there is already one playing
-    // on this channel
-
-    ReleaseSoundOnChannel(channel);
-
     // Get the sound data
 
     if (!LockSound(sfxinfo))
@@ -880,15 +925,23 @@ static int I_SDL_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep)
 
     snd = sfxinfo->driver_data;
 
-    // play sound
+    // [SVE]: play sound, with separation etc., under one hold of the
+    // audio lock so the mixer never hears it unpanned; this replaces
+    // any sound already playing on this channel
 
+    GetPanning(vol, sep, &left, &right);
+
+    SDL_LockAudio();
     Mix_PlayChannelTimed(channel, &snd->chunk, 0, -1);
+    SetChannelPanning(channel, left, right);
+    SDL_UnlockAudio();
 
-    channels_playing[channel] = sfxinfo;
+    // Release a sound effect if there was already one playing
+    // on this channel; the mixer has let go of it by now
 
-    // set separation, etc.
- 
-    I_SDL_UpdateSoundParams(channel, vol, sep);
+    ReleaseSoundOnChannel(channel);
+
+    channels_playing[channel] = sfxinfo;
 
     return channel;
 }
@@ -939,6 +992,19 @@ static void I_SDL_UpdateSound(void)
             ReleaseSoundOnChannel(i);
         }
     }
+
+    // [SVE]: warn once if the mixer callbacks are less regular than the
+    // slice is long; the buffer is too small for this system.
+
+    if (!jitter_reported && audiostats.callbacks > 100
+     && audiostats.avgjitter_us > audiostats.slice_us)
+    {
+        fprintf(stderr, "I_SDL_UpdateSound: mixer callback jitter (%i us) "
+                        "exceeds the %i us slice; consider raising "
+                        "snd_maxslicetime_ms.\n",
+                        audiostats.avgjitter_us, audiostats.slice_us);
+        jitter_reported = true;
+    }
 }
 
 static void I_SDL_ShutdownSound(void)
@@ -948,6 +1014,7 @@ static void I_SDL_ShutdownSound(void)
         return;
     }
 
+    Mix_UnregisterEffect(MIX_CHANNEL_POST, MeasureCallbackTiming);
     Mix_CloseAudio();
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
@@ -1058,6 +1125,14 @@ static boolean I_SDL_InitSound(boolean _use_sfx_prefix)
 
     Mix_AllocateChannels(NUM_CHANNELS);
 
+    // [SVE]: watch the mixer callback timing
+
+    last_callback_time = 0;
+    jitter_reported = false;
+    memset(&audiostats, 0, sizeof(audiostats));
+
+    Mix_RegisterEffect(MIX_CHANNEL_POST, MeasureCallbackTiming, NULL, NULL);
+
     SDL_PauseAudio(0);
 
     sound_initialized = true;
@@ -234,6 +234,18 @@ extern int snd_cachesize;
 extern int snd_maxslicetime_ms;
 extern char *snd_musiccmd;
 
+// [SVE]: mixer thread statistics
+
+typedef struct
+{
+    int slice_us;               // nominal length of one mixer callback
+    int callbacks;              // mixer callbacks since startup
+    int avgjitter_us;           // average deviation from slice_us
+    int maxjitter_us;           // worst deviation from slice_us
+} audiostats_t;
+
+extern audiostats_t audiostats;
+
 void I_BindSoundVariables(void);
 
 #endif
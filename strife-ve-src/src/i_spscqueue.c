@@ -0,0 +1,141 @@
+//
+// Copyright(C) 2014 Night Dive Studios, Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//    Single-producer, single-consumer lock-free ring buffer.
+//
+//    head and tail are free-running counters; the number of queued
+//    elements is always head - tail, which stays correct across
+//    unsigned wrap-around. SDL_AtomicGet/SDL_AtomicSet act as full
+//    barriers, so element data written before a commit is visible to
+//    the other side before the counter that publishes it.
+//
+
+#include <stdlib.h>
+
+#include "i_spscqueue.h"
+#include "i_system.h"
+
+//
+// I_SPSCInit
+//
+// Capacity is rounded up to the next power of two.
+//
+
+void I_SPSCInit(spscqueue_t *queue, unsigned int elemsize, unsigned int count)
+{
+    unsigned int capacity = 1;
+
+    while(capacity < count)
+    {
+        capacity <<= 1;
+    }
+
+    queue->data = calloc(capacity, elemsize);
+
+    if(queue->data == NULL)
+    {
+        I_Error("I_SPSCInit: failed to allocate %u elements of %u bytes",
+                capacity, elemsize);
+    }
+
+    queue->elemsize = elemsize;
+    queue->mask = capacity - 1;
+
+    SDL_AtomicSet(&queue->head, 0);
+    SDL_AtomicSet(&queue->tail, 0);
+}
+
+//
+// I_SPSCFree
+//
+
+void I_SPSCFree(spscqueue_t *queue)
+{
+    free(queue->data);
+    queue->data = NULL;
+    queue->mask = 0;
+}
+
+//
+// I_SPSCWriteSlot
+//
+
+void *I_SPSCWriteSlot(spscqueue_t *queue)
+{
+    unsigned int head = (unsigned int)SDL_AtomicGet(&queue->head);
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&queue->tail);
+
+    if(head - tail > queue->mask)
+    {
+        return NULL;
+    }
+
+    return queue->data + (head & queue->mask) * queue->elemsize;
+}
+
+//
+// I_SPSCCommitWrite
+//
+
+void I_SPSCCommitWrite(spscqueue_t *queue)
+{
+    SDL_AtomicSet(&queue->head, SDL_AtomicGet(&queue->head) + 1);
+}
+
+//
+// I_SPSCReadSlot
+//
+
+void *I_SPSCReadSlot(spscqueue_t *queue)
+{
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&queue->tail);
+    unsigned int head = (unsigned int)SDL_AtomicGet(&queue->head);
+
+    if(head == tail)
+    {
+        return NULL;
+    }
+
+    return queue->data + (tail & queue->mask) * queue->elemsize;
+}
+
+//
+// I_SPSCCommitRead
+//
+
+void I_SPSCCommitRead(spscqueue_t *queue)
+{
+    SDL_AtomicSet(&queue->tail, SDL_AtomicGet(&queue->tail) + 1);
+}
+
+//
+// I_SPSCCount
+//
+
+unsigned int I_SPSCCount(spscqueue_t *queue)
+{
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&queue->tail);
+    unsigned int head = (unsigned int)SDL_AtomicGet(&queue->head);
+
+    return head - tail;
+}
+
+//
+// I_SPSCCapacity
+//
+
+unsigned int I_SPSCCapacity(spscqueue_t *queue)
+{
+    return queue->mask + 1;
+}
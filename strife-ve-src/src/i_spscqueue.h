@@ -0,0 +1,55 @@
+//
+// Copyright(C) 2014 Night Dive Studios, Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//    Single-producer, single-consumer lock-free ring buffer, used to
+//    pass work between the game thread and the audio/decoder threads
+//    without taking a mutex.
+//
+
+#ifndef __I_SPSCQUEUE__
+#define __I_SPSCQUEUE__
+
+#include "SDL.h"
+#include "doomtype.h"
+
+typedef struct
+{
+    byte            *data;
+    unsigned int    elemsize;
+    unsigned int    mask;       // capacity - 1; capacity is a power of two
+    SDL_atomic_t    head;       // next slot to write, only stored by producer
+    SDL_atomic_t    tail;       // next slot to read, only stored by consumer
+} spscqueue_t;
+
+void I_SPSCInit(spscqueue_t *queue, unsigned int elemsize, unsigned int count);
+void I_SPSCFree(spscqueue_t *queue);
+
+// Producer side. I_SPSCWriteSlot returns the next free element or NULL
+// if the queue is full; it becomes visible to the consumer only once
+// I_SPSCCommitWrite is called.
+
+void *I_SPSCWriteSlot(spscqueue_t *queue);
+void I_SPSCCommitWrite(spscqueue_t *queue);
+
+// Consumer side. I_SPSCReadSlot returns the oldest element or NULL if
+// the queue is empty; the slot stays owned by the consumer until
+// I_SPSCCommitRead is called.
+
+void *I_SPSCReadSlot(spscqueue_t *queue);
+void I_SPSCCommitRead(spscqueue_t *queue);
+
+unsigned int I_SPSCCount(spscqueue_t *queue);
+unsigned int I_SPSCCapacity(spscqueue_t *queue);
+
+#endif
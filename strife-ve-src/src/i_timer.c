@@ -71,6 +71,25 @@ int I_GetTimeMS(void)
     return ticks - basetime;
 }
 
+//
+// I_GetTimeUS
+//
+// [SVE]: high resolution timestamp in microseconds, for profiling.
+// Unlike the above it has no base time and only differences between
+// two calls mean anything.
+//
+
+uint64_t I_GetTimeUS(void)
+{
+    static Uint64 freq;
+    Uint64 counter = SDL_GetPerformanceCounter();
+
+    if (freq == 0)
+        freq = SDL_GetPerformanceFrequency();
+
+    return (counter / freq) * 1000000 + ((counter % freq) * 1000000) / freq;
+}
+
 // Sleep for a specified number of ms
 
 void I_Sleep(int ms)
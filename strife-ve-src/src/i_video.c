@@ -37,6 +37,7 @@
 #include "doomkeys.h"
 
 // [SVE] svillarreal - from gl scale branch
+#include "i_capture.h"
 #include "i_glscale.h"
 
 #include "i_joystick.h"
@@ -163,17 +164,20 @@ static SDL_Renderer *renderer;
 
 static char *window_title = "";
 
-// Intermediate 8-bit buffer that we draw to instead of 'screen'.
-// This is used when we are rendering in 32-bit screen mode.
-// When in a real 8-bit screen mode, screenbuffer == screen.
+// [SVE] Streaming truecolor texture that I_VideoBuffer is expanded
+// into on every present when not using OpenGL.
 
 static SDL_Texture *screentexture = NULL;
-static SDL_Surface *screenbuffer = NULL;
 
 // palette
 
 static SDL_Palette *palette = NULL;
-static boolean palette_to_set;
+
+// [SVE] The current palette as RGBA bytes. Presenting a frame is one
+// table lookup per pixel, and a palette flash only has to rebuild
+// these 256 entries rather than reupload a palette.
+
+static uint32_t palette_rgba[256];
 
 // display has been set up?
 
@@ -1128,16 +1132,13 @@ void I_EndRead(void)
 
 static void FinishUpdateSoftware(void)
 {
+    void *pixels;
+    int pitch;
+
     // draw to screen
 
 	//BlitArea(0, 0, SCREENWIDTH, SCREENHEIGHT);
 
-	if (palette_to_set)
-	{
-		SDL_SetSurfacePalette(screenbuffer, palette);
-        palette_to_set = false;
-    }
-
 /*
     // In 8in32 mode, we must blit from the fake 8-bit screen buffer
     // to the real screen before doing a screen flip.
@@ -1156,7 +1157,27 @@ static void FinishUpdateSoftware(void)
 
 	SDL_Flip(screen);*/
 
-	SDL_UpdateTexture(screentexture, NULL, I_VideoBuffer, 320);
+    // expand straight into the texture, no intermediate copy
+    if (SDL_LockTexture(screentexture, NULL, &pixels, &pitch) == 0)
+    {
+        byte *src = I_VideoBuffer;
+        int x, y;
+
+        for (y = 0; y < SCREENHEIGHT; ++y)
+        {
+            uint32_t *dest = (uint32_t *)((byte *)pixels + y * pitch);
+
+            for (x = 0; x < SCREENWIDTH; ++x)
+            {
+                dest[x] = palette_rgba[src[x]];
+            }
+
+            src += SCREENWIDTH;
+        }
+
+        SDL_UnlockTexture(screentexture);
+    }
+
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, screentexture, NULL, NULL);
 	SDL_RenderPresent(renderer);
@@ -1181,7 +1202,6 @@ void I_FinishUpdate (void)
     {
         ApplyWindowResize(resize_w, resize_h);
         need_resize = false;
-        palette_to_set = true;
     }
 
     UpdateGrab();
@@ -1216,7 +1236,7 @@ void I_FinishUpdate (void)
 
         if(!use3drenderer)
         {
-			I_GL_UpdateScreen(I_VideoBuffer, palette->colors);
+			I_GL_UpdateScreen(I_VideoBuffer, palette_rgba);
         }
         else
         {
@@ -1224,6 +1244,9 @@ void I_FinishUpdate (void)
             RB_DrawPatchBuffer();
         }
 
+        // [SVE]: grab the frame before the cursor goes on
+        I_CaptureFrame(use3drenderer ? NULL : I_VideoBuffer, palette_rgba);
+
         if(show_visual_cursor)
         {
             if(i_seemouses || !i_seejoysticks) // haleyjd 20141202: this is overtime work.
@@ -1237,6 +1260,7 @@ void I_FinishUpdate (void)
     }
     else
     {
+        I_CaptureFrame(I_VideoBuffer, palette_rgba);
         FinishUpdateSoftware();
     }
 }
@@ -1262,15 +1286,20 @@ void I_SetPalette (byte *doompalette)
 
     for (i=0; i<256; ++i)
     {
+        byte *rgba = (byte *) &palette_rgba[i];
+
         // Zero out the bottom two bits of each channel - the PC VGA
         // controller only supports 6 bits of accuracy.
 
 		palette->colors[i].r = gammatable[usegamma][*doompalette++] & ~3;
 		palette->colors[i].g = gammatable[usegamma][*doompalette++] & ~3;
 		palette->colors[i].b = gammatable[usegamma][*doompalette++] & ~3;
-    }
 
-    palette_to_set = true;
+        rgba[0] = palette->colors[i].r;
+        rgba[1] = palette->colors[i].g;
+        rgba[2] = palette->colors[i].b;
+        rgba[3] = 0xff;
+    }
 }
 
 // Given an RGB value, find the closest matching palette index.
@@ -1973,13 +2002,14 @@ static void SetVideoMode(screen_mode_t *mode, int w, int h)
 
     doompal = W_CacheLumpName(DEH_String("PLAYPAL"), PU_CACHE);
 
-    // If we are already running and in a true color mode, we need
-    // to free the screenbuffer surface before setting the new mode.
+    // If we are already running, we need to free the screen
+    // texture before setting the new mode.
 
     // [SVE] svillarreal - from gl scale branch
-	if (!using_opengl && screenbuffer != NULL)
+	if (!using_opengl && screentexture != NULL)
     {
-		SDL_DestroyTexture(screenbuffer);
+		SDL_DestroyTexture(screentexture);
+        screentexture = NULL;
     }
 
     // Generate lookup tables before setting the video mode.
@@ -2090,14 +2120,19 @@ static void SetVideoMode(screen_mode_t *mode, int w, int h)
 
         screen_mode = mode;
 
-		screentexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_INDEX8,
-										  SDL_TEXTUREACCESS_STREAMING,
-										  mode->width,
-										  mode->height);
+        // [SVE] The renderer can't take paletted textures, so use
+        // one that matches palette_rgba's byte order and let the
+        // renderer do the scaling.
 
-		screenbuffer = SDL_CreateRGBSurface(SDL_SWSURFACE,
-											mode->width, mode->height, 8,
-											0, 0, 0, 0);
+		screentexture = SDL_CreateTexture(renderer,
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+                                          SDL_PIXELFORMAT_RGBA8888,
+#else
+                                          SDL_PIXELFORMAT_ABGR8888,
+#endif
+										  SDL_TEXTUREACCESS_STREAMING,
+										  SCREENWIDTH,
+										  SCREENHEIGHT);
     }
 }
 
@@ -22,6 +22,7 @@
 
 #include "doomtype.h"
 #include "i_swap.h"
+#include "memio.h"
 #include "midifile.h"
 
 #define HEADER_CHUNK_ID "MThd"
@@ -62,6 +63,7 @@ typedef struct
 
     midi_event_t *events;
     int num_events;
+    int num_events_alloced;
 } midi_track_t;
 
 struct midi_track_iter_s
@@ -106,28 +108,20 @@ static boolean CheckChunkHeader(chunk_header_t *chunk,
 
 // Read a single byte.  Returns false on error.
 
-static boolean ReadByte(byte *result, FILE *stream)
+static boolean ReadByte(byte *result, MEMFILE *stream)
 {
-    int c;
-
-    c = fgetc(stream);
-
-    if (c == EOF)
+    if (mem_fread(result, 1, 1, stream) != 1)
     {
         fprintf(stderr, "ReadByte: Unexpected end of file\n");
         return false;
     }
-    else
-    {
-        *result = (byte) c;
 
-        return true;
-    }
+    return true;
 }
 
 // Read a variable-length value.
 
-static boolean ReadVariableLength(unsigned int *result, FILE *stream)
+static boolean ReadVariableLength(unsigned int *result, MEMFILE *stream)
 {
     int i;
     byte b;
@@ -163,7 +157,7 @@ static boolean ReadVariableLength(unsigned int *result, FILE *stream)
 
 // Read a byte sequence into the data buffer.
 
-static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
+static void *ReadByteSequence(unsigned int num_bytes, MEMFILE *stream)
 {
     unsigned int i;
     byte *result;
@@ -181,15 +175,14 @@ static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
 
     // Read the data:
 
-    for (i=0; i<num_bytes; ++i)
+    i = mem_fread(result, 1, num_bytes, stream);
+
+    if (i < num_bytes)
     {
-        if (!ReadByte(&result[i], stream))
-        {
-            fprintf(stderr, "ReadByteSequence: Error while reading byte %u\n",
-                            i);
-            free(result);
-            return NULL;
-        }
+        fprintf(stderr, "ReadByteSequence: Error while reading byte %u\n",
+                        i);
+        free(result);
+        return NULL;
     }
 
     return result;
@@ -201,7 +194,7 @@ static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
 
 static boolean ReadChannelEvent(midi_event_t *event,
                                 byte event_type, boolean two_param,
-                                FILE *stream)
+                                MEMFILE *stream)
 {
     byte b;
 
@@ -241,7 +234,7 @@ static boolean ReadChannelEvent(midi_event_t *event,
 // Read sysex event:
 
 static boolean ReadSysExEvent(midi_event_t *event, int event_type,
-                              FILE *stream)
+                              MEMFILE *stream)
 {
     event->event_type = event_type;
 
@@ -267,7 +260,7 @@ static boolean ReadSysExEvent(midi_event_t *event, int event_type,
 
 // Read meta event:
 
-static boolean ReadMetaEvent(midi_event_t *event, FILE *stream)
+static boolean ReadMetaEvent(midi_event_t *event, MEMFILE *stream)
 {
     byte b;
 
@@ -306,7 +299,7 @@ static boolean ReadMetaEvent(midi_event_t *event, FILE *stream)
 }
 
 static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
-                         FILE *stream)
+                         MEMFILE *stream)
 {
     byte event_type;
 
@@ -331,7 +324,7 @@ static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
     {
         event_type = *last_event_type;
 
-        if (fseek(stream, -1, SEEK_CUR) < 0)
+        if (mem_fseek(stream, -1, MEM_SEEK_CUR) < 0)
         {
             fprintf(stderr, "ReadEvent: Unable to seek in stream\n");
             return false;
@@ -410,12 +403,12 @@ static void FreeEvent(midi_event_t *event)
 
 // Read and check the track chunk header
 
-static boolean ReadTrackHeader(midi_track_t *track, FILE *stream)
+static boolean ReadTrackHeader(midi_track_t *track, MEMFILE *stream)
 {
     size_t records_read;
     chunk_header_t chunk_header;
 
-    records_read = fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
+    records_read = mem_fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
 
     if (records_read < 1)
     {
@@ -432,13 +425,14 @@ static boolean ReadTrackHeader(midi_track_t *track, FILE *stream)
     return true;
 }
 
-static boolean ReadTrack(midi_track_t *track, FILE *stream)
+static boolean ReadTrack(midi_track_t *track, MEMFILE *stream)
 {
     midi_event_t *new_events;
     midi_event_t *event;
     unsigned int last_event_type;
 
     track->num_events = 0;
+    track->num_events_alloced = 0;
     track->events = NULL;
 
     // Read the header:
@@ -454,17 +448,28 @@ static boolean ReadTrack(midi_track_t *track, FILE *stream)
 
     for (;;)
     {
-        // Resize the track slightly larger to hold another event:
-
-        new_events = realloc(track->events, 
-                             sizeof(midi_event_t) * (track->num_events + 1));
+        // Grow the track to hold another event:
 
-        if (new_events == NULL)
+        if (track->num_events == track->num_events_alloced)
         {
-            return false;
-        }
+            int new_alloced = track->num_events_alloced * 2;
+
+            if (new_alloced < 64)
+            {
+                new_alloced = 64;
+            }
 
-        track->events = new_events;
+            new_events = realloc(track->events,
+                                 sizeof(midi_event_t) * new_alloced);
+
+            if (new_events == NULL)
+            {
+                return false;
+            }
+
+            track->events = new_events;
+            track->num_events_alloced = new_alloced;
+        }
 
         // Read the next event:
 
@@ -502,7 +507,7 @@ static void FreeTrack(midi_track_t *track)
     free(track->events);
 }
 
-static boolean ReadAllTracks(midi_file_t *file, FILE *stream)
+static boolean ReadAllTracks(midi_file_t *file, MEMFILE *stream)
 {
     unsigned int i;
 
@@ -532,12 +537,12 @@ static boolean ReadAllTracks(midi_file_t *file, FILE *stream)
 
 // Read and check the header chunk.
 
-static boolean ReadFileHeader(midi_file_t *file, FILE *stream)
+static boolean ReadFileHeader(midi_file_t *file, MEMFILE *stream)
 {
     size_t records_read;
     unsigned int format_type;
 
-    records_read = fread(&file->header, sizeof(midi_header_t), 1, stream);
+    records_read = mem_fread(&file->header, sizeof(midi_header_t), 1, stream);
 
     if (records_read < 1)
     {
@@ -584,10 +589,13 @@ void MIDI_FreeFile(midi_file_t *file)
     free(file);
 }
 
-midi_file_t *MIDI_LoadFile(char *filename)
+// Load a MIDI file from a memory buffer. The buffer is not referenced
+// after this returns.
+
+midi_file_t *MIDI_LoadFileFromMem(void *buf, size_t buflen)
 {
     midi_file_t *file;
-    FILE *stream;
+    MEMFILE *stream;
 
     file = malloc(sizeof(midi_file_t));
 
@@ -601,37 +609,70 @@ midi_file_t *MIDI_LoadFile(char *filename)
     file->buffer = NULL;
     file->buffer_size = 0;
 
-    // Open file
+    stream = mem_fopen_read(buf, buflen);
 
-    stream = fopen(filename, "rb");
+    // Read MIDI file header
 
-    if (stream == NULL)
+    if (!ReadFileHeader(file, stream))
     {
-        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
+        mem_fclose(stream);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read MIDI file header
+    // Read all tracks:
 
-    if (!ReadFileHeader(file, stream))
+    if (!ReadAllTracks(file, stream))
     {
-        fclose(stream);
+        mem_fclose(stream);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read all tracks:
+    mem_fclose(stream);
 
-    if (!ReadAllTracks(file, stream))
+    return file;
+}
+
+midi_file_t *MIDI_LoadFile(char *filename)
+{
+    midi_file_t *file;
+    FILE *stream;
+    byte *buf;
+    long buflen;
+
+    // Open file
+
+    stream = fopen(filename, "rb");
+
+    if (stream == NULL)
+    {
+        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
+        return NULL;
+    }
+
+    // Read it into memory in one go and parse from there.
+
+    fseek(stream, 0, SEEK_END);
+    buflen = ftell(stream);
+    fseek(stream, 0, SEEK_SET);
+
+    buf = malloc(buflen + 1);
+
+    if (buf == NULL || fread(buf, 1, buflen, stream) < buflen)
     {
+        fprintf(stderr, "MIDI_LoadFile: Failed to read '%s'\n", filename);
+        free(buf);
         fclose(stream);
-        MIDI_FreeFile(file);
         return NULL;
     }
 
     fclose(stream);
 
+    file = MIDI_LoadFileFromMem(buf, buflen);
+
+    free(buf);
+
     return file;
 }
 
@@ -719,6 +760,186 @@ void MIDI_RestartIterator(midi_track_iter_t *iter)
     iter->position = 0;
 }
 
+// Event gathered from a track, before sorting into song order.
+
+typedef struct
+{
+    unsigned int ticks;         // absolute time in ticks
+    unsigned int order;         // tie-break: track number, then position
+    midi_event_t *event;
+    unsigned short track;
+} song_sort_t;
+
+static int SortSongEvents(const void *a, const void *b)
+{
+    const song_sort_t *sa = a;
+    const song_sort_t *sb = b;
+
+    if (sa->ticks != sb->ticks)
+    {
+        return sa->ticks < sb->ticks ? -1 : 1;
+    }
+
+    return sa->order < sb->order ? -1 : sa->order > sb->order;
+}
+
+// Returns true if the event is needed for playback of a flattened song.
+
+static boolean SongKeepsEvent(midi_event_t *event)
+{
+    switch (event->event_type)
+    {
+        case MIDI_EVENT_SYSEX:
+        case MIDI_EVENT_SYSEX_SPLIT:
+            return false;
+
+        case MIDI_EVENT_META:
+            return event->data.meta.type == MIDI_META_END_OF_TRACK;
+
+        default:
+            return true;
+    }
+}
+
+// Build a flattened song from a loaded MIDI file: the events of every
+// track are merged into one array ordered by time, and tempo changes
+// are resolved so that each event carries its absolute time since the
+// start of the song. Timestamps are in microseconds multiplied by
+// time_scale.
+
+midi_song_t *MIDI_BuildSong(midi_file_t *file, unsigned int time_scale)
+{
+    midi_song_t *song;
+    song_sort_t *sorted;
+    unsigned int num_sorted;
+    unsigned int division;
+    unsigned int tempo;
+    unsigned int base_ticks;
+    uint64_t base_time;
+    unsigned int i, j, n;
+
+    division = MIDI_GetFileTimeDivision(file);
+
+    if (division == 0)
+    {
+        division = 96;
+    }
+
+    // Gather every event with its absolute time in ticks.
+
+    num_sorted = 0;
+
+    for (i=0; i<file->num_tracks; ++i)
+    {
+        num_sorted += file->tracks[i].num_events;
+    }
+
+    sorted = malloc(sizeof(song_sort_t) * (num_sorted + 1));
+    song = malloc(sizeof(midi_song_t));
+
+    if (sorted == NULL || song == NULL)
+    {
+        free(sorted);
+        free(song);
+        return NULL;
+    }
+
+    n = 0;
+
+    for (i=0; i<file->num_tracks; ++i)
+    {
+        midi_track_t *track = &file->tracks[i];
+        unsigned int ticks = 0;
+
+        for (j=0; j<track->num_events; ++j)
+        {
+            ticks += track->events[j].delta_time;
+
+            sorted[n].ticks = ticks;
+            sorted[n].order = n;
+            sorted[n].event = &track->events[j];
+            sorted[n].track = i;
+            ++n;
+        }
+    }
+
+    qsort(sorted, num_sorted, sizeof(song_sort_t), SortSongEvents);
+
+    song->events = malloc(sizeof(midi_song_event_t) * (num_sorted + 1));
+    song->num_events = 0;
+    song->num_tracks = file->num_tracks;
+
+    if (song->events == NULL)
+    {
+        free(sorted);
+        free(song);
+        return NULL;
+    }
+
+    // Walk the merged events, applying tempo changes as they come.
+    // Default is 120 bpm.
+
+    tempo = 500 * 1000;
+    base_ticks = 0;
+    base_time = 0;
+
+    for (i=0; i<num_sorted; ++i)
+    {
+        midi_event_t *event = sorted[i].event;
+        midi_song_event_t *out;
+        uint64_t time;
+
+        time = base_time
+             + ((uint64_t) (sorted[i].ticks - base_ticks) * tempo * time_scale)
+             / division;
+
+        if (event->event_type == MIDI_EVENT_META
+         && event->data.meta.type == MIDI_META_SET_TEMPO
+         && event->data.meta.length == 3)
+        {
+            byte *data = event->data.meta.data;
+
+            base_ticks = sorted[i].ticks;
+            base_time = time;
+            tempo = (data[0] << 16) | (data[1] << 8) | data[2];
+            continue;
+        }
+
+        if (!SongKeepsEvent(event))
+        {
+            continue;
+        }
+
+        out = &song->events[song->num_events++];
+        out->time = time;
+        out->track = sorted[i].track;
+        out->event_type = event->event_type;
+
+        if (event->event_type == MIDI_EVENT_META)
+        {
+            out->channel = 0;
+            out->param1 = event->data.meta.type;
+            out->param2 = 0;
+        }
+        else
+        {
+            out->channel = event->data.channel.channel;
+            out->param1 = event->data.channel.param1;
+            out->param2 = event->data.channel.param2;
+        }
+    }
+
+    free(sorted);
+
+    return song;
+}
+
+void MIDI_FreeSong(midi_song_t *song)
+{
+    free(song->events);
+    free(song);
+}
+
 #ifdef TEST
 
 static char *MIDI_EventTypeToString(midi_event_type_t event_type)
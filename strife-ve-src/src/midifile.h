@@ -127,10 +127,42 @@ typedef struct
     } data;
 } midi_event_t;
 
+// Event in a flattened song. Channel events keep their type (without
+// the channel nibble), channel and parameters; end-of-track meta events
+// keep MIDI_META_END_OF_TRACK in param1.
+
+typedef struct
+{
+    // Absolute time since the start of the song, with all tempo
+    // changes applied.
+    uint64_t time;
+
+    // Track the event came from; channel state is per track.
+    unsigned short track;
+
+    byte event_type;
+    byte channel;
+    byte param1;
+    byte param2;
+} midi_song_event_t;
+
+// All tracks of a MIDI file merged into one array, ordered by time.
+
+typedef struct
+{
+    midi_song_event_t *events;
+    unsigned int num_events;
+    unsigned int num_tracks;
+} midi_song_t;
+
 // Load a MIDI file.
 
 midi_file_t *MIDI_LoadFile(char *filename);
 
+// Load a MIDI file from memory.
+
+midi_file_t *MIDI_LoadFileFromMem(void *buf, size_t buflen);
+
 // Free a MIDI file.
 
 void MIDI_FreeFile(midi_file_t *file);
@@ -163,5 +195,14 @@ int MIDI_GetNextEvent(midi_track_iter_t *iter, midi_event_t **event);
 
 void MIDI_RestartIterator(midi_track_iter_t *iter);
 
+// Merge the tracks of a MIDI file into a flattened song. Event times
+// are in microseconds multiplied by time_scale.
+
+midi_song_t *MIDI_BuildSong(midi_file_t *file, unsigned int time_scale);
+
+// Free a flattened song.
+
+void MIDI_FreeSong(midi_song_t *song);
+
 #endif /* #ifndef MIDIFILE_H */
 
@@ -30,6 +30,7 @@
 #include "i_video.h"
 #include "m_bbox.h"
 #include "w_wad.h"
+#include "z_zone.h"
 #include "r_defs.h"
 #include "r_state.h"
 
@@ -42,6 +43,12 @@ extern int f_w, f_h;
 static rbTexture_t *markTextures[10];
 static rbTexture_t *objMarkIcon;
 
+// [SVE]: automap lines are queued with their colour per vertex and
+//  drawn as one batch, rather than a glBegin/glEnd for every line
+static vtx_t *amLineVerts;
+static int amLineVertCount;
+static int amLineVertMax;
+
 //
 // RB_SetupAutomapView
 //
@@ -89,6 +96,56 @@ static void RB_SetupAutomapView(rbView_t *view)
     RB_SetupFrameForView(view, 45.0f);
 }
 
+//
+// RB_GetAutomapExtents
+//
+// [SVE]: bounding box of the map area the GL automap shows at the
+// height its lines are drawn, from where the side planes of its
+// frustum meet. The view is wider than the software window whenever
+// the screen is wider than 4:3. Returns false if the corners can't be
+// found.
+//
+
+boolean RB_GetAutomapExtents(fixed_t *box)
+{
+    static const int corners[4][2] =
+    {
+        { FP_LEFT,  FP_BOTTOM },
+        { FP_LEFT,  FP_TOP    },
+        { FP_RIGHT, FP_BOTTOM },
+        { FP_RIGHT, FP_TOP    }
+    };
+    int i;
+
+    M_ClearBox(box);
+
+    for(i = 0; i < 4; ++i)
+    {
+        float *p1 = rbAutomapView.frustum[corners[i][0]];
+        float *p2 = rbAutomapView.frustum[corners[i][1]];
+        float det = p1[0] * p2[1] - p2[0] * p1[1];
+        float x, y;
+
+        if(fabs(det) < 0.0001f)
+        {
+            return false;
+        }
+
+        // solve both planes at z = 0
+        x = (p2[3] * p1[1] - p1[3] * p2[1]) / det;
+        y = (p1[3] * p2[0] - p2[3] * p1[0]) / det;
+
+        if(fabs(x) >= 32767.0f || fabs(y) >= 32767.0f)
+        {
+            return false;
+        }
+
+        M_AddToBox(box, FLOAT2FIXED(x), FLOAT2FIXED(y));
+    }
+
+    return true;
+}
+
 //
 // RB_DrawAutomapLine
 //
@@ -99,6 +156,8 @@ void RB_DrawAutomapLine(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int colo
     fixed_t bbox[4];
     float fx1, fy1;
     float fx2, fy2;
+    vtx_t *v;
+    int i;
     
     M_ClearBox(bbox);
     M_AddToBox(bbox, x1, y1);
@@ -116,18 +175,52 @@ void RB_DrawAutomapLine(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int colo
     fx2 = FIXED2FLOAT(x2);
     fy2 = FIXED2FLOAT(y2);
 
-    RB_BindTexture(&whiteTexture);
     I_GetPaletteColor(rgb, color);
 
-    //
-    // I despise opengl immediate mode but I just can't be arsed
-    // to do anything fancy here
-    //
-    dglBegin(GL_LINES);
-    dglColor4ub(rgb[0], rgb[1], rgb[2], 0xff);
-    dglVertex3f(fx1, fy1, 0);
-    dglVertex3f(fx2, fy2, 0);
-    dglEnd();
+    if(amLineVertCount + 2 > amLineVertMax)
+    {
+        amLineVertMax = amLineVertMax ? amLineVertMax * 2 : 1024;
+        amLineVerts = Z_Realloc(amLineVerts, amLineVertMax * sizeof(vtx_t), PU_STATIC, NULL);
+    }
+
+    v = &amLineVerts[amLineVertCount];
+    amLineVertCount += 2;
+
+    v[0].x = fx1;
+    v[0].y = fy1;
+    v[1].x = fx2;
+    v[1].y = fy2;
+
+    for(i = 0; i < 2; ++i)
+    {
+        v[i].z = 0;
+        v[i].tu = v[i].tv = 0;
+        v[i].r = rgb[0];
+        v[i].g = rgb[1];
+        v[i].b = rgb[2];
+        v[i].a = 0xff;
+    }
+}
+
+//
+// RB_FlushAutomapLines
+//
+// Draws everything queued by RB_DrawAutomapLine. Called before
+// anything else goes on top of the lines.
+//
+
+static void RB_FlushAutomapLines(void)
+{
+    if(amLineVertCount == 0)
+    {
+        return;
+    }
+
+    RB_BindTexture(&whiteTexture);
+    RB_BindDrawPointers(amLineVerts);
+    dglDrawArrays(GL_LINES, 0, amLineVertCount);
+
+    amLineVertCount = 0;
 }
 
 //
@@ -145,6 +238,8 @@ void RB_DrawObjectiveMarker(fixed_t x, fixed_t y)
     float fscale;
     int alpha;
 
+    RB_FlushAutomapLines();
+
     // if not loaded, then do it now
     if(!objMarkIcon)
     {
@@ -221,6 +316,8 @@ void RB_DrawMark(fixed_t x, fixed_t y, int marknum)
         return;
     }
 
+    RB_FlushAutomapLines();
+
     for(i = 0; i < 4; ++i)
     {
         v[i].r = v[i].g = v[i].b = v[i].a = 0xff;
@@ -456,6 +553,7 @@ void RB_BeginAutomapDraw(void)
 
 void RB_EndAutomapDraw(void)
 {
+     RB_FlushAutomapLines();
      RB_ResetViewPort();
      RB_DrawExtraHudPics();
 }
@@ -22,5 +22,6 @@ void RB_EndAutomapDraw(void);
 void RB_DrawObjectiveMarker(fixed_t x, fixed_t y);
 void RB_DrawMark(fixed_t x, fixed_t y, int marknum);
 void RB_DrawAutomapLine(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int color);
+boolean RB_GetAutomapExtents(fixed_t *box);
 
 #endif
@@ -31,6 +31,7 @@
 #include "rb_things.h"
 #include "rb_wallshade.h"
 #include "rb_dynlights.h"
+#include "rb_occlusion.h"
 #include "rb_config.h"
 #include "r_main.h"
 #include "r_defs.h"
@@ -41,6 +42,7 @@
 #include "doomstat.h"
 
 static int currentssect = 0;
+static boolean occludedssect = false;
 
 typedef enum
 {
@@ -85,6 +87,73 @@ static float RB_SegDistanceToView(seg_t *seg)
                   rbPlayerView.y * seg->linedef->fny) - pd);
 }
 
+//
+// RB_AddDynLightLists
+//
+// Adds the draw lists for the lights touching the current subsector to
+// a wall or flat. Without the clustered light shader that is one list per
+// light, with the light as data and the surface number as params.
+// Otherwise the surface itself is the data and each list carries up to
+// DYNLIGHT_PASSLIGHTS light numbers in its flags.
+//
+
+static void RB_AddDynLightLists(void *surface, int surfacenum,
+                                boolean (*procfunc)(struct vtxlist_s*, int*), int flags)
+{
+    byte lights[MAX_DYNLIGHTS];
+    vtxlist_t *list;
+    int count;
+    int i;
+    int j;
+
+    count = RB_GetSubsectorLights(currentssect, lights);
+
+    if(RB_UseDynLightShader())
+    {
+        // the regular blend scales the framebuffer once per pass, so it
+        // only gets one light at a time
+        int perpass = rbDynamicLightFastBlend ? DYNLIGHT_PASSLIGHTS : 1;
+
+        for(i = 0; i < count; i += perpass)
+        {
+            list = DL_AddVertexList(&drawlist[DLT_DYNLIGHT]);
+            list->data = surface;
+            list->procfunc = procfunc;
+            list->preprocess = 0;
+            list->postprocess = rbDynamicLightFastBlend ? 0 : RB_DynLightPostProcess;
+            list->texid = 0;
+            list->fparams = 0;
+            list->flags = flags | DLF_LIGHTCLUSTER;
+
+            // consecutive lists with the same params are drawn together; a
+            // hundred or so surfaces stays well inside the vertex buffer
+            list->params = (drawlist[DLT_DYNLIGHT].index - 1) >> 7;
+
+            for(j = 0; j < DYNLIGHT_PASSLIGHTS; ++j)
+            {
+                int light = (j < perpass && i + j < count) ? lights[i + j] : DYNLIGHT_NONE;
+
+                list->flags |= light << (DYNLIGHT_FLAGSHIFT + j * 8);
+            }
+        }
+
+        return;
+    }
+
+    for(i = 0; i < count; ++i)
+    {
+        list = DL_AddVertexList(&drawlist[DLT_DYNLIGHT]);
+        list->data = (rbDynLight_t*)RB_GetDynLight(lights[i]);
+        list->procfunc = procfunc;
+        list->preprocess = 0;
+        list->postprocess = rbDynamicLightFastBlend ? 0 : RB_DynLightPostProcess;
+        list->flags = flags;
+        list->texid = 0;
+        list->fparams = 0;
+        list->params = surfacenum;
+    }
+}
+
 //
 // RB_AddSegToDrawlist
 //
@@ -167,30 +236,7 @@ static void RB_AddSegToDrawlist(seg_t *seg, int texid, bspSide_t sidetype)
         // dynamic light draw lists
         if(rbDynamicLights)
         {
-            int marknum = RB_SubsectorMarked(currentssect);
-            
-            if(marknum)
-            {
-                int i;
-                
-                for(i = 0; i < MAX_DYNLIGHTS; ++i)
-                {
-                    if(!(marknum & (1 << i)))
-                    {
-                        continue;
-                    }
-                    
-                    list = DL_AddVertexList(&drawlist[DLT_DYNLIGHT]);
-                    list->data = (rbDynLight_t*)RB_GetDynLight(i);
-                    list->procfunc = procsegs[1][sidetype];
-                    list->preprocess = 0;
-                    list->postprocess = rbDynamicLightFastBlend ? 0 : RB_DynLightPostProcess;
-                    list->flags = 0;
-                    list->texid = 0;
-                    list->fparams = 0;
-                    list->params = seg - segs;
-                }
-            }
+            RB_AddDynLightLists(seg, seg - segs, procsegs[1][sidetype], 0);
         }
 
         // lightmap draw lists
@@ -245,7 +291,6 @@ static void RB_AddLeafToDrawlist(subsector_t *sub, int texid, boolean bCeiling)
 {
     vtxlist_t *list;
     sector_t *sector = sub->sector;
-    int marknum;
     
     // add initial draw list
     list = DL_AddVertexList(&drawlist[DLT_FLAT]);
@@ -284,34 +329,8 @@ static void RB_AddLeafToDrawlist(subsector_t *sub, int texid, boolean bCeiling)
     // add dynamic light draw list
     if(rbDynamicLights)
     {
-        marknum = RB_SubsectorMarked(currentssect);
-        
-        if(marknum)
-        {
-            int i;
-            
-            for(i = 0; i < MAX_DYNLIGHTS; ++i)
-            {
-                if(!(marknum & (1 << i)))
-                {
-                    continue;
-                }
-                
-                list = DL_AddVertexList(&drawlist[DLT_DYNLIGHT]);
-                list->data = (rbDynLight_t*)RB_GetDynLight(i);
-                list->preprocess = 0;
-                list->postprocess = rbDynamicLightFastBlend ? 0 : RB_DynLightPostProcess;
-                list->procfunc = RB_GenerateDynLightFlat;
-                list->texid = 0;
-                list->fparams = 0;
-                list->params = sub - subsectors;
-
-                if(bCeiling)
-                {
-                    list->flags |= DLF_CEILING;
-                }
-            }
-        }
+        RB_AddDynLightLists(sub, sub - subsectors, RB_GenerateDynLightFlat,
+                            bCeiling ? DLF_CEILING : 0);
     }
 
     // add lightmap drawlist
@@ -517,7 +536,8 @@ void RB_AddLine(seg_t* seg)
         RB_Clipper_SafeAddClipRange(angle2, angle1);
     }
 
-    if(!infrustum)
+    // [SVE]: segs of an occluded subsector still fill the clipper above
+    if(!infrustum || occludedssect)
     {
         return;
     }
@@ -680,6 +700,10 @@ void RB_Subsector(int num)
     // haleyjd: set sector shade(s) now
     RB_SetSectorShades(sector);
 
+    // [SVE]: leave out the walls and flats of a subsector that has
+    // been hidden behind other geometry for the last few frames
+    occludedssect = RB_CheckSubsectorOcclusion(num);
+
     for(i = 0; i < sub->numleafs; i++)
     {
         leaf = &leafs[sub->leaf + i];
@@ -718,14 +742,17 @@ void RB_Subsector(int num)
         }
     }
 
-    if(viewz > sector->floorheight && sector->floorpic != skyflatnum)
+    if(!occludedssect)
     {
-        RB_AddLeafToDrawlist(sub, sector->floorpic, false);
-    }
+        if(viewz > sector->floorheight && sector->floorpic != skyflatnum)
+        {
+            RB_AddLeafToDrawlist(sub, sector->floorpic, false);
+        }
 
-    if(viewz < sector->ceilingheight && sector->ceilingpic != skyflatnum)
-    {
-        RB_AddLeafToDrawlist(sub, sector->ceilingpic, true);
+        if(viewz < sector->ceilingheight && sector->ceilingpic != skyflatnum)
+        {
+            RB_AddLeafToDrawlist(sub, sector->ceilingpic, true);
+        }
     }
 
     RB_AddSprites(sub);
@@ -735,40 +762,53 @@ void RB_Subsector(int num)
 //
 // RB_RenderBSPNode
 //
+// [SVE]: both halves are walked recursively so occlusion culling can
+// see where each node's subtree starts and ends, and skip the subtree
+// of a node whose subsectors were all hidden last frame
+//
 
 void RB_RenderBSPNode(int bspnum)
 {
     node_t  *bsp;
     int     side;
+    occlusionwalk_t walk;
 
-    while(!(bspnum & NF_SUBSECTOR))
+    if(bspnum & NF_SUBSECTOR)
     {
-        bsp = &nodes[bspnum];
-
-        // Decide which side the view point is on.
-        side = R_PointOnSide(viewx, viewy, bsp);
-
-        // check the front space
-        if(RB_CheckBBox(bsp->bbox[side]))
+        // subsector with contents
+        // add all the drawable elements in the subsector
+        if(bspnum == -1)
         {
-            RB_RenderBSPNode(bsp->children[side]);
+            bspnum = 0;
         }
 
-        // continue down the back space
-        if(!RB_CheckBBox(bsp->bbox[side^1]))
-        {
-            return;
-        }
+        RB_Subsector(bspnum & ~NF_SUBSECTOR);
+        return;
+    }
 
-        bspnum = bsp->children[side^1];
+    if(RB_CheckNodeOcclusion(bspnum))
+    {
+        return;
+    }
+
+    RB_BeginNodeWalk(&walk);
+
+    bsp = &nodes[bspnum];
+
+    // Decide which side the view point is on.
+    side = R_PointOnSide(viewx, viewy, bsp);
+
+    // check the front space
+    if(RB_CheckBBox(bsp->bbox[side]))
+    {
+        RB_RenderBSPNode(bsp->children[side]);
     }
 
-    // subsector with contents
-    // add all the drawable elements in the subsector
-    if(bspnum == -1)
+    // then the back space
+    if(RB_CheckBBox(bsp->bbox[side^1]))
     {
-        bspnum = 0;
+        RB_RenderBSPNode(bsp->children[side^1]);
     }
 
-    RB_Subsector(bspnum & ~NF_SUBSECTOR);
+    RB_EndNodeWalk(bspnum, &walk);
 }
@@ -25,42 +25,52 @@
 #include "z_zone.h"
 #include <math.h>
 
-typedef struct clipnode_s
-{
-    struct clipnode_s *prev, *next;
-    angle_t start, end;
-} clipnode_t;
+//
+// [SVE]: the clipped angles are kept as a sorted array of disjoint ranges
+// rather than a linked list, so both the visibility test and insertion
+// find their place with a binary search. ranges that overlap or touch are
+// merged as they're added, which means a range is hidden exactly when it
+// falls inside one entry.
+//
 
+typedef struct
+{
+    angle_t start;
+    angle_t end;
+} cliprange_t;
 
-clipnode_t *freelist    = NULL;
-clipnode_t *clipnodes   = NULL;
-clipnode_t *cliphead    = NULL;
+static cliprange_t *clipranges  = NULL;
+static int numclipranges        = 0;
+static int maxclipranges        = 0;
 
-static clipnode_t * RB_Clipnode_NewRange(angle_t start, angle_t end);
 static boolean RB_Clipper_IsRangeVisible(angle_t startAngle, angle_t endAngle);
 static void RB_Clipper_AddClipRange(angle_t start, angle_t end);
-static void RB_Clipper_RemoveRange(clipnode_t * range);
-static void RB_Clipnode_Free(clipnode_t *node);
 
-static clipnode_t *RB_Clipnode_GetNew(void)
+//
+// RB_Clipper_FindRange
+// Returns the first range that ends at or after angle
+//
+
+static int RB_Clipper_FindRange(angle_t angle)
 {
-    if(freelist)
+    int lo = 0;
+    int hi = numclipranges;
+
+    while(lo < hi)
     {
-        clipnode_t *p = freelist;
-        freelist = p->next;
-        return p;
-    }
+        int mid = (lo + hi) >> 1;
 
-    return malloc(sizeof(clipnode_t));
-}
+        if(clipranges[mid].end < angle)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
 
-static clipnode_t * RB_Clipnode_NewRange(angle_t start, angle_t end)
-{
-    clipnode_t *c = RB_Clipnode_GetNew();
-    c->start = start;
-    c->end = end;
-    c->next = c->prev=NULL;
-    return c;
+    return lo;
 }
 
 //
@@ -78,54 +88,17 @@ boolean RB_Clipper_SafeCheckRange(angle_t startAngle, angle_t endAngle)
 
 static boolean RB_Clipper_IsRangeVisible(angle_t startAngle, angle_t endAngle)
 {
-    clipnode_t *ci;
-    ci = cliphead;
+    int i = RB_Clipper_FindRange(startAngle);
 
-    if(endAngle == 0 && ci && ci->start == 0)
+    if(i < numclipranges &&
+       clipranges[i].start <= startAngle && endAngle <= clipranges[i].end)
     {
         return false;
     }
 
-    while(ci != NULL && ci->start < endAngle)
-    {
-        if(startAngle >= ci->start && endAngle <= ci->end)
-        {
-            return false;
-        }
-
-        ci = ci->next;
-    }
-
     return true;
 }
 
-static void RB_Clipnode_Free(clipnode_t *node)
-{
-    node->next = freelist;
-    freelist = node;
-}
-
-static void RB_Clipper_RemoveRange(clipnode_t *range)
-{
-    if(range == cliphead)
-    {
-        cliphead = cliphead->next;
-    }
-    else {
-        if(range->prev)
-        {
-            range->prev->next = range->next;
-        }
-
-        if(range->next)
-        {
-            range->next->prev = range->prev;
-        }
-    }
-
-    RB_Clipnode_Free(range);
-}
-
 //
 // RB_Clipper_SafeAddClipRange
 //
@@ -147,106 +120,47 @@ void RB_Clipper_SafeAddClipRange(angle_t startangle, angle_t endangle)
 
 static void RB_Clipper_AddClipRange(angle_t start, angle_t end)
 {
-    clipnode_t *node, *temp, *prevNode;
-    if(cliphead)
-    {
-        //check to see if range contains any old ranges
-        node = cliphead;
-        while(node != NULL && node->start < end)
-        {
-            if(node->start >= start && node->end <= end)
-            {
-                temp = node;
-                node = node->next;
-                RB_Clipper_RemoveRange(temp);
-            }
-            else
-            {
-                if(node->start <= start && node->end >= end)
-                {
-                    return;
-                }
-                else
-                {
-                    node = node->next;
-                }
-            }
-        }
-        //check to see if range overlaps a range (or possibly 2)
-        node = cliphead;
-        while(node != NULL)
-        {
-            if(node->start >= start && node->start <= end)
-            {
-                node->start = start;
-                return;
-            }
-            if(node->end >= start && node->end <= end)
-            {
-                // check for possible merger
-                if(node->next && node->next->start <= end)
-                {
-                    node->end = node->next->end;
-                    RB_Clipper_RemoveRange(node->next);
-                }
-                else
-                {
-                    node->end = end;
-                }
-
-                return;
-            }
-
-            node = node->next;
-        }
+    int first;
+    int last;
 
-        //just add range
-        node = cliphead;
-        prevNode = NULL;
+    // ranges [first, last) overlap or touch the new one
+    first = RB_Clipper_FindRange(start);
 
-        temp = RB_Clipnode_NewRange(start, end);
+    for(last = first; last < numclipranges && clipranges[last].start <= end; ++last);
 
-        while(node != NULL && node->start < end)
+    if(first == last)
+    {
+        // nothing to merge with; open up a slot
+        if(numclipranges == maxclipranges)
         {
-            prevNode = node;
-            node = node->next;
+            maxclipranges = maxclipranges ? maxclipranges * 2 : 64;
+            clipranges = Z_Realloc(clipranges, maxclipranges * sizeof(cliprange_t),
+                                   PU_STATIC, NULL);
         }
 
-        temp->next = node;
-
-        if(node == NULL)
-        {
-            temp->prev = prevNode;
+        memmove(&clipranges[first + 1], &clipranges[first],
+                (numclipranges - first) * sizeof(cliprange_t));
 
-            if(prevNode)
-            {
-                prevNode->next = temp;
-            }
+        clipranges[first].start = start;
+        clipranges[first].end = end;
+        numclipranges++;
+        return;
+    }
 
-            if(!cliphead) {
-                cliphead = temp;
-            }
-        }
-        else
-        {
-            if(node == cliphead)
-            {
-                cliphead->prev = temp;
-                cliphead = temp;
-            }
-            else
-            {
-                temp->prev = prevNode;
-                prevNode->next = temp;
-                node->prev = temp;
-            }
-        }
+    // fold everything it touches into the first of them
+    if(clipranges[first].start > start)
+    {
+        clipranges[first].start = start;
     }
-    else
+
+    clipranges[first].end = MAX(end, clipranges[last - 1].end);
+
+    if(last - first > 1)
     {
-        temp = RB_Clipnode_NewRange(start, end);
-        cliphead = temp;
-        return;
+        memmove(&clipranges[first + 1], &clipranges[last],
+                (numclipranges - last) * sizeof(cliprange_t));
+
+        numclipranges -= (last - first - 1);
     }
 }
 
@@ -256,15 +170,5 @@ static void RB_Clipper_AddClipRange(angle_t start, angle_t end)
 
 void RB_Clipper_Clear(void)
 {
-    clipnode_t *node = cliphead;
-    clipnode_t *temp;
-
-    while(node != NULL)
-    {
-        temp = node;
-        node = node->next;
-        RB_Clipnode_Free(temp);
-    }
-
-    cliphead = NULL;
+    numclipranges = 0;
 }
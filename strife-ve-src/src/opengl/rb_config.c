@@ -29,10 +29,13 @@ boolean rbLightmaps = true;
 boolean rbLightmapsDefault = true;
 boolean rbDynamicLights = true;
 boolean rbDynamicLightFastBlend = false;
+boolean rbDynamicLightShader = true;
+boolean rbOcclusionCulling = false;
+int     rbPlayerViews = 0;
 boolean rbForceSync = false;
 boolean rbCrosshair = false;
 boolean rbDecals = true;
-int     rbMaxDecals = 128;
+int     rbMaxDecals = 1024;
 float   rbFOV = 74.0f;
 
 // motion blur
@@ -46,6 +49,7 @@ boolean rbEnableFXAA = true;
 // bloom
 boolean rbEnableBloom = true;
 float   rbBloomThreshold = 0.485f;
+int     rbBloomQuality = BLOOMQUALITY_MEDIUM;
 
 //
 // RB_BindVariables
@@ -62,6 +66,9 @@ void RB_BindVariables(void)
     M_BindVariableWithDefault("gl_lightmaps", &rbLightmaps, &rbLightmapsDefault);
     M_BindVariable("gl_dynamic_lights", &rbDynamicLights);
     M_BindVariable("gl_dynamic_light_fast_blend", &rbDynamicLightFastBlend);
+    M_BindVariable("gl_dynamic_light_shader", &rbDynamicLightShader);
+    M_BindVariable("gl_occlusion_culling", &rbOcclusionCulling);
+    M_BindVariable("gl_player_views", &rbPlayerViews);
     M_BindVariable("gl_force_sync", &rbForceSync);
     M_BindVariable("gl_show_crosshair", &rbCrosshair);
     M_BindVariable("gl_decals", &rbDecals);
@@ -73,4 +80,5 @@ void RB_BindVariables(void)
     M_BindVariable("gl_enable_fxaa", &rbEnableFXAA);
     M_BindVariable("gl_enable_bloom", &rbEnableBloom);
     M_BindVariable("gl_bloom_threshold", &rbBloomThreshold);
+    M_BindVariable("gl_bloom_quality", &rbBloomQuality);
 }
@@ -27,6 +27,9 @@ extern boolean  rbLightmaps;
 extern boolean  rbLightmapsDefault;
 extern boolean  rbDynamicLights;
 extern boolean  rbDynamicLightFastBlend;
+extern boolean  rbDynamicLightShader;
+extern boolean  rbOcclusionCulling;
+extern int      rbPlayerViews;
 extern boolean  rbForceSync;
 extern boolean  rbCrosshair;
 extern boolean  rbDecals;
@@ -38,6 +41,18 @@ extern int      rbMotionBlurSamples;
 extern boolean  rbEnableFXAA;
 extern boolean  rbEnableBloom;
 extern float    rbBloomThreshold;
+extern int      rbBloomQuality;
+
+// [SVE]: gl_bloom_quality presets. classic blurs at full resolution,
+// the others go through a mip chain of increasing depth
+enum
+{
+    BLOOMQUALITY_CLASSIC,
+    BLOOMQUALITY_LOW,
+    BLOOMQUALITY_MEDIUM,
+    BLOOMQUALITY_HIGH,
+    NUMBLOOMQUALITY
+};
 
 void RB_BindVariables(void);
 
@@ -51,6 +66,9 @@ void RB_BindVariables(void);
     CONFIG_VARIABLE_INT(gl_lightmaps),                  \
     CONFIG_VARIABLE_INT(gl_dynamic_lights),             \
     CONFIG_VARIABLE_INT(gl_dynamic_light_fast_blend),   \
+    CONFIG_VARIABLE_INT(gl_dynamic_light_shader),       \
+    CONFIG_VARIABLE_INT(gl_occlusion_culling),          \
+    CONFIG_VARIABLE_INT(gl_player_views),               \
     CONFIG_VARIABLE_INT(gl_force_sync),                 \
     CONFIG_VARIABLE_INT(gl_show_crosshair),             \
     CONFIG_VARIABLE_INT(gl_decals),                     \
@@ -61,6 +79,7 @@ void RB_BindVariables(void);
     CONFIG_VARIABLE_INT(gl_motion_blur_samples),        \
     CONFIG_VARIABLE_INT(gl_enable_fxaa),                \
     CONFIG_VARIABLE_INT(gl_enable_bloom),               \
-    CONFIG_VARIABLE_FLOAT(gl_bloom_threshold),
+    CONFIG_VARIABLE_FLOAT(gl_bloom_threshold),          \
+    CONFIG_VARIABLE_INT(gl_bloom_quality),
 
 #endif
@@ -26,6 +26,7 @@
 #include "rb_draw.h"
 #include "rb_decal.h"
 #include "rb_matrix.h"
+#include "m_bbox.h"
 #include "m_random.h"
 #include "p_local.h"
 #include "r_state.h"
@@ -35,7 +36,11 @@
 #include "deh_str.h"
 #include "m_parser.h"
 
-static rbDecal_t decalhead;
+// [SVE]: decals are carved out of blocks that are never handed back to
+// the zone, so a firefight doesn't churn it with spawns and expiries
+#define DECALPOOL_BLOCK     256
+
+static rbDecal_t *decalfree;
 static int activedecals;
 static line_t *decalwall = NULL;
 
@@ -46,6 +51,10 @@ static fixed_t decal_z;
 static rbDecalDef_t *decalDefs;
 static int numDecalDefs;
 
+// one active list per decal def. every decal of a def shares its
+// lifetime, so each list is already ordered by when its decals expire
+static rbDecal_t *decalLists;
+
 //
 // RB_InitDecals
 //
@@ -76,6 +85,7 @@ void RB_InitDecals(void)
         rbDecalDef_t *decalDef;
 
         decalDefs = (rbDecalDef_t*)Z_Calloc(1, size, PU_STATIC, 0);
+        decalLists = (rbDecal_t*)Z_Calloc(numDecalDefs, sizeof(rbDecal_t), PU_STATIC, 0);
         M_ParserReset(lexer);
 
         decalDef = decalDefs;
@@ -161,6 +171,7 @@ void RB_InitDecals(void)
     }
 
     M_ParserClose();
+    RB_ClearDecalLinks();
 }
 
 //
@@ -171,7 +182,7 @@ static rbDecalDef_t *RB_GetDecalDef(mobjtype_t type)
 {
     int i;
     
-    for(i = 0; numDecalDefs; ++i)
+    for(i = 0; i < numDecalDefs; ++i)
     {
         if(decalDefs[i].mobjtype == type)
         {
@@ -193,20 +204,19 @@ static rbDecalDef_t *RB_GetDecalDef(mobjtype_t type)
 
 static void RB_LinkDecal(rbDecal_t *decal)
 {
-    sector_t *sec;
+    subsector_t *sub;
 
-    decal->ssect = R_PointInSubsector(decal->x, decal->y);
-    sec = decal->ssect->sector;
+    sub = decal->ssect = R_PointInSubsector(decal->x, decal->y);
 
     decal->sprev = NULL;
-    decal->snext = sec->decallist;
+    decal->snext = sub->decallist;
 
-    if(sec->decallist)
+    if(sub->decallist)
     {
-        sec->decallist->sprev = decal;
+        sub->decallist->sprev = decal;
     }
 
-    sec->decallist = decal;
+    sub->decallist = decal;
 }
 
 //
@@ -226,52 +236,140 @@ static void RB_UnlinkDecal(rbDecal_t *decal)
     }
     else
     {
-        decal->ssect->sector->decallist = decal->snext;
+        decal->ssect->decallist = decal->snext;
     }
 }
 
 //
-// RB_UpdateDecals
+// RB_AllocDecal
 //
 
-void RB_UpdateDecals(void)
+static rbDecal_t *RB_AllocDecal(void)
 {
     rbDecal_t *decal;
 
-    for(decal = decalhead.next; decal != &decalhead; decal = decal->next)
+    if(!decalfree)
     {
-        if(decal->tics <= decal->fadetime)
-        {
-            decal->alpha -= (((float)decal->def->startingAlpha / decal->fadetime) / 255.0f);
+        rbDecal_t *block;
+        int i;
 
-            if(decal->alpha < 0)
-            {
-                decal->alpha = 0;
-            }
+        block = (rbDecal_t*)Z_Malloc(DECALPOOL_BLOCK * sizeof(rbDecal_t), PU_STATIC, 0);
+
+        for(i = 0; i < DECALPOOL_BLOCK; ++i)
+        {
+            block[i].next = decalfree;
+            decalfree = &block[i];
         }
+    }
+
+    decal = decalfree;
+    decalfree = decal->next;
+
+    memset(decal, 0, sizeof(*decal));
+    return decal;
+}
+
+//
+// RB_FreeDecal
+//
+
+static void RB_FreeDecal(rbDecal_t *decal)
+{
+    decal->next->prev = decal->prev;
+    decal->prev->next = decal->next;
+
+    RB_UnlinkDecal(decal);
+
+    decal->next = decalfree;
+    decalfree = decal;
+
+    activedecals--;
+}
+
+//
+// RB_FreeOldestDecal
+// Frees whichever decal is closest to expiring
+//
 
-        if(activedecals >= rbMaxDecals || !decal->tics--)
+static void RB_FreeOldestDecal(void)
+{
+    rbDecal_t *oldest = NULL;
+    int i;
+
+    for(i = 0; i < numDecalDefs; ++i)
+    {
+        rbDecal_t *decal = decalLists[i].next;
+
+        if(decal != &decalLists[i] && (!oldest || decal->endtic < oldest->endtic))
         {
-            rbDecal_t *decalTmp = decal;
-            rbDecal_t *next = decalTmp->next;
+            oldest = decal;
+        }
+    }
 
-            (next->prev = decal = decalTmp->prev)->next = next;
+    if(oldest)
+    {
+        RB_FreeDecal(oldest);
+    }
+}
+
+//
+// RB_UpdateDecals
+//
+// Fading is worked out from endtic when the decal is drawn, so all
+// that is left here is dropping the expired decals off the front of
+// each list and trimming down to gl_max_decals.
+//
+
+void RB_UpdateDecals(void)
+{
+    int i;
 
-            RB_UnlinkDecal(decalTmp);
-            Z_Free(decalTmp);
+    for(i = 0; i < numDecalDefs; ++i)
+    {
+        rbDecal_t *head = &decalLists[i];
 
-            activedecals--;
+        while(head->next != head && head->next->endtic <= leveltime)
+        {
+            RB_FreeDecal(head->next);
         }
     }
+
+    while(activedecals > rbMaxDecals)
+    {
+        RB_FreeOldestDecal();
+    }
 }
 
 //
 // RB_ClearDecalLinks
 //
+// Subsectors have already been freed by the time this runs at level
+// setup, so decals go back to the pool without being unlinked from them.
+//
 
 void RB_ClearDecalLinks(void)
 {
-    decalhead.next = decalhead.prev = &decalhead;
+    int i;
+
+    for(i = 0; i < numDecalDefs; ++i)
+    {
+        rbDecal_t *head = &decalLists[i];
+
+        if(head->next)
+        {
+            while(head->next != head)
+            {
+                rbDecal_t *decal = head->next;
+
+                head->next = decal->next;
+                decal->next = decalfree;
+                decalfree = decal;
+            }
+        }
+
+        head->next = head->prev = head;
+    }
+
     activedecals = 0;
 }
 
@@ -367,15 +465,35 @@ static void RB_CarveDecal(rbDecal_t *decal)
     int leftcount;
     int rightcount;
     byte pointsides[NUM_DECAL_POINTS];
+    fixed_t bbox[4];
     int i, j;
     
     sector = decal->ssect->sector;
+
+    // [SVE]: carving only ever shrinks the decal, so its starting bounds
+    // are enough to throw out the sector lines that can't touch it
+    M_ClearBox(bbox);
+
+    for(j = 0; j < decal->numpoints; ++j)
+    {
+        M_AddToBox(bbox,
+                   FLOAT2FIXED(decal->points[j].x),
+                   FLOAT2FIXED(decal->points[j].y));
+    }
     
     for(i = 0; i < sector->linecount; ++i)
     {
         boolean ok = false;
 
         line = sector->lines[i];
+
+        if(line->bbox[BOXRIGHT] < bbox[BOXLEFT] ||
+           line->bbox[BOXLEFT] > bbox[BOXRIGHT] ||
+           line->bbox[BOXTOP] < bbox[BOXBOTTOM] ||
+           line->bbox[BOXBOTTOM] > bbox[BOXTOP])
+        {
+            continue;
+        }
         
         if(line->backsector)
         {
@@ -548,10 +666,17 @@ static void RB_CarveDecal(rbDecal_t *decal)
 static rbDecal_t *RB_CreateDecal(rbDecalDef_t *decalDef)
 {
     rbDecal_t *decal;
-    
-    decal = Z_Calloc(1, sizeof(*decal), PU_LEVEL, 0);
+    rbDecal_t *head;
+
+    // make room by retiring the decal that would have gone next anyway
+    if(activedecals >= rbMaxDecals)
+    {
+        RB_FreeOldestDecal();
+    }
+
+    decal = RB_AllocDecal();
     decal->def = decalDef;
-    decal->tics = decalDef->lifetime;
+    decal->endtic = leveltime + decalDef->lifetime;
     decal->lump = decalDef->lumpnum + (M_Random() % decalDef->count);
     decal->offset = M_Random() & 7;
     decal->alpha = (float)decalDef->startingAlpha / 255.0f;
@@ -574,11 +699,14 @@ static rbDecal_t *RB_CreateDecal(rbDecalDef_t *decalDef)
         decal->rotation = 0;
     }
 
-    decalhead.prev->next = decal;
-    decal->next = &decalhead;
-    decal->prev = decalhead.prev;
-    decalhead.prev = decal;
+    head = &decalLists[decalDef - decalDefs];
+
+    head->prev->next = decal;
+    decal->next = head;
+    decal->prev = head->prev;
+    head->prev = decal;
 
+    activedecals++;
     return decal;
 }
 
@@ -836,7 +964,6 @@ void RB_SpawnWallDecal(mobj_t *mobj)
     }
 
     RB_RotateDecalTextureCoords(decal);
-    activedecals++;
 }
 
 //
@@ -930,7 +1057,6 @@ void RB_SpawnFloorDecal(mobj_t *mobj, boolean floor)
     
     RB_CarveDecal(decal);
     RB_RotateDecalTextureCoords(decal);
-    activedecals++;
 }
 
 //
@@ -942,6 +1068,8 @@ static boolean RB_GenerateDecal(vtxlist_t *vl, int *drawcount)
     vtx_t *v;
     rbDecal_t *decal;
     float offset;
+    float alpha;
+    int remaining;
     int count;
     int i;
 
@@ -965,6 +1093,15 @@ static boolean RB_GenerateDecal(vtxlist_t *vl, int *drawcount)
         offset = FIXED2FLOAT(decal->initialStickZ - decal->stickSector->floorheight);
     }
 
+    // fade linearly over the last fadetime tics
+    alpha = decal->alpha;
+    remaining = decal->endtic - leveltime;
+
+    if(remaining < decal->fadetime)
+    {
+        alpha = remaining <= 0 ? 0 : alpha * (float)remaining / (float)decal->fadetime;
+    }
+
     for(i = 0; i < decal->numpoints; ++i)
     {
         v[i].x = decal->points[i].x;
@@ -977,7 +1114,7 @@ static boolean RB_GenerateDecal(vtxlist_t *vl, int *drawcount)
         v[i].r =
         v[i].g =
         v[i].b =
-        v[i].a = (byte)(decal->alpha * 255.0f);
+        v[i].a = (byte)(alpha * 255.0f);
     }
 
     *drawcount += decal->numpoints;
@@ -1008,13 +1145,8 @@ void RB_AddDecals(subsector_t *sub)
 {
     rbDecal_t *decal;
 
-    for(decal = sub->sector->decallist; decal; decal = decal->snext)
+    for(decal = sub->decallist; decal; decal = decal->snext)
     {
-        if(decal->ssect != sub)
-        {
-            continue;
-        }
-
         RB_AddDecalDrawlist(decal);
     }
 }
@@ -58,7 +58,7 @@ typedef enum
 
 typedef struct rbDecal_s
 {
-    int                 tics;
+    int                 endtic;
     int                 fadetime;
     int                 lump;
     fixed_t             x;
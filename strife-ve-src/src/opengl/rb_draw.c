@@ -29,6 +29,8 @@
 #include "rb_shader.h"
 #include "rb_wallshade.h"
 #include "rb_lightgrid.h"
+#include "rb_dynlights.h"
+#include "rb_occlusion.h"
 #include "rb_wipe.h"
 #include "rb_hudtext.h"
 #include "rb_things.h"
@@ -104,6 +106,18 @@ static rbShader_t bloomShader;
 static rbfbo_t blurFBO[2];
 static rbShader_t blurShader;
 
+// [SVE]: bloom mip chain; level 0 is half the screen size and every
+// level after it halves again. each level has a scratch FBO of the
+// same size for the separable blur
+#define MAX_BLOOM_LEVELS    6
+
+static rbfbo_t bloomLevelFBO[MAX_BLOOM_LEVELS];
+static rbfbo_t bloomTempFBO[MAX_BLOOM_LEVELS];
+static int numBloomLevels;
+
+// number of chain levels used by each gl_bloom_quality preset
+static const int bloomQualityLevels[NUMBLOOMQUALITY] = { 0, 2, 4, 6 };
+
 // motion blur
 extern float rendertic_msec;
 extern unsigned int rendertic_step;
@@ -209,6 +223,7 @@ void RB_InitDrawer(void)
 {
     int w;
     int h;
+    int i;
 
     RB_PatchBufferInit();
     
@@ -231,10 +246,28 @@ void RB_InitDrawer(void)
     FBO_InitColorAttachment(&blurFBO[0], 0, w >> 1, h >> 1);
     FBO_InitColorAttachment(&blurFBO[1], 0, w >> 3, h >> 3);
 
+    for(i = 0; i < MAX_BLOOM_LEVELS; ++i)
+    {
+        int lw = w >> (i + 1);
+        int lh = h >> (i + 1);
+
+        if(lw < 1 || lh < 1)
+        {
+            break;
+        }
+
+        FBO_InitColorAttachment(&bloomLevelFBO[i], 0, lw, lh);
+        FBO_InitColorAttachment(&bloomTempFBO[i], 0, lw, lh);
+    }
+
+    numBloomLevels = i;
+
+    SP_Init();
     SP_LoadProgram(&motionBlurShader, "MBLUR");
     SP_LoadProgram(&fxaaShader, "FXAA");
     SP_LoadProgram(&blurShader, "BLUR");
     SP_LoadProgram(&bloomShader, "BLOOM");
+    RB_InitDynLightShader();
 
     bShowLightCells = M_CheckParm("-showlightcells");
 }
@@ -245,16 +278,27 @@ void RB_InitDrawer(void)
 
 void RB_ShutdownDrawer(void)
 {
+    int i;
+
     SP_Delete(&fxaaShader);
     SP_Delete(&blurShader);
     SP_Delete(&bloomShader);
     SP_Delete(&motionBlurShader);
+    RB_ShutdownDynLightShader();
 
     FBO_Delete(&spriteFBO);
     FBO_Delete(&blurFBO[0]);
     FBO_Delete(&blurFBO[1]);
     FBO_Delete(&bloomFBO);
 
+    for(i = 0; i < numBloomLevels; ++i)
+    {
+        FBO_Delete(&bloomLevelFBO[i]);
+        FBO_Delete(&bloomTempFBO[i]);
+    }
+
+    numBloomLevels = 0;
+
     RB_DeleteTexture(&whiteTexture);
     RB_DeleteTexture(&lightPointTexture);
     RB_DeleteTexture(&frameBufferTexture);
@@ -1136,6 +1180,99 @@ void RB_RenderFXAA(void)
     RB_DisableShaders();
 }
 
+//
+// RB_DrawBloomLevel
+// Runs the quad bound by RB_RenderBloom into one level of the
+// bloom chain, with the viewport sized to that level
+//
+
+static void RB_DrawBloomLevel(rbfbo_t *dst, rbfbo_t *src)
+{
+    FBO_Bind(dst);
+    dglViewport(0, 0, dst->fboWidth, dst->fboHeight);
+
+    if(src)
+    {
+        FBO_BindImage(src);
+    }
+
+    RB_DrawElements();
+    FBO_UnBind(dst);
+}
+
+//
+// RB_RenderBloomChain
+// [SVE]: thresholds at half resolution, then walks down the mip chain
+// blurring each level at its own size and walks back up adding each
+// level onto the one above it. every pass touches at most a quarter of
+// the pixels the full screen blur did, and there is no compute involved
+//
+
+static void RB_RenderBloomChain(const float threshold, const int levels)
+{
+    int i;
+
+    dglPushAttrib(GL_VIEWPORT_BIT);
+
+    RB_SetState(GLSTATE_CULL, true);
+    RB_SetCull(GLCULL_FRONT);
+    RB_SetState(GLSTATE_DEPTHTEST, false);
+    RB_SetState(GLSTATE_BLEND, false);
+    RB_SetState(GLSTATE_ALPHATEST, false);
+
+    // threshold straight into the half size level
+    RB_BindFrameBuffer(&frameBufferTexture);
+    SP_Enable(&bloomShader);
+    SP_SetUniform1i(&bloomShader, "uDiffuse", 0);
+    SP_SetUniform1f(&bloomShader, "uBloomThreshold", threshold);
+
+    RB_DrawBloomLevel(&bloomLevelFBO[0], NULL);
+
+    SP_Enable(&blurShader);
+    SP_SetUniform1i(&blurShader, "uDiffuse", 0);
+    SP_SetUniform1f(&blurShader, "uBlurRadius", 1.0f);
+
+    // downsample: the blit halves the previous level with linear
+    // filtering, then a horizontal and vertical blur at that size
+    for(i = 0; i < levels; ++i)
+    {
+        if(i > 0)
+        {
+            FBO_CopyFrameBuffer(&bloomLevelFBO[i], &bloomLevelFBO[i-1],
+                                bloomLevelFBO[i-1].fboWidth,
+                                bloomLevelFBO[i-1].fboHeight);
+        }
+
+        SP_SetUniform1f(&blurShader, "uSize", (float)bloomLevelFBO[i].fboWidth);
+        SP_SetUniform1i(&blurShader, "uDirection", 1);
+        RB_DrawBloomLevel(&bloomTempFBO[i], &bloomLevelFBO[i]);
+
+        SP_SetUniform1f(&blurShader, "uSize", (float)bloomLevelFBO[i].fboHeight);
+        SP_SetUniform1i(&blurShader, "uDirection", 0);
+        RB_DrawBloomLevel(&bloomLevelFBO[i], &bloomTempFBO[i]);
+    }
+
+    RB_DisableShaders();
+
+    // upsample: screen blend each level onto the next larger one so the
+    // wide, soft glow of the small levels doesn't blow out to white
+    RB_SetState(GLSTATE_BLEND, true);
+    RB_SetBlend(GLSRC_ONE_MINUS_DST_COLOR, GLDST_ONE);
+
+    for(i = levels - 1; i > 0; --i)
+    {
+        RB_DrawBloomLevel(&bloomLevelFBO[i-1], &bloomLevelFBO[i]);
+    }
+
+    RB_ResetElements();
+
+    // composite over the scene like the full resolution path does
+    dglViewport(0, 0, screen_width, screen_height);
+    FBO_Draw(&bloomLevelFBO[0], true);
+
+    dglPopAttrib();
+}
+
 //
 // RB_RenderBloom
 //
@@ -1192,6 +1329,15 @@ void RB_RenderBloom(void)
     if(bloomThreshold < 0.4f) bloomThreshold = 0.4f;
     if(bloomThreshold > 1.0f) bloomThreshold = 1.0f;
 
+    // [SVE]: anything other than the classic preset goes through the chain
+    if(rbBloomQuality > 0 && numBloomLevels > 0)
+    {
+        int levels = bloomQualityLevels[MIN(rbBloomQuality, NUMBLOOMQUALITY - 1)];
+
+        RB_RenderBloomChain(bloomThreshold, MIN(levels, numBloomLevels));
+        return;
+    }
+
     // pass 1: bloom
     RB_BindFrameBuffer(&frameBufferTexture);
     FBO_Bind(&bloomFBO);
@@ -1581,6 +1727,9 @@ void RB_DrawScene(void)
     // draw walls and flats
     DL_ProcessDrawList(DLT_WALL);
     DL_ProcessDrawList(DLT_FLAT);
+
+    // test subsector bounds against the opaque depth for the next frame
+    RB_DrawOcclusionQueries();
     
     // draw brightmaps
     RB_SetDepth(GLFUNC_EQUAL);
@@ -1650,7 +1799,9 @@ void RB_DrawScene(void)
         RB_SetDepth(GLFUNC_EQUAL);
         
         RB_BindTexture(&lightPointTexture);
+        RB_BeginDynLightShader();
         DL_ProcessDrawList(DLT_DYNLIGHT);
+        RB_EndDynLightShader();
         
         RB_SetDepth(GLFUNC_LEQUAL);
     }
@@ -23,6 +23,7 @@
 #include "rb_things.h"
 #include "rb_config.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "z_zone.h"
 
 drawlist_t drawlist[NUMDRAWLISTS];
@@ -62,132 +63,197 @@ vtxlist_t *DL_AddVertexList(drawlist_t *dl)
     return &dl->list[dl->index++];
 }
 
+//=============================================================================
+//
+// Sorting
 //
-// SortTranWalls
+// [SVE]: lists are sorted with an LSD radix sort over 32-bit keys paired
+// with the entry's index, then the entries are gathered into place once.
+// The key and gather buffers persist across frames and levels and only
+// ever grow. Passes where every key shares the same byte are skipped,
+// which is most of them for small texture ids and params.
 //
+//=============================================================================
 
-static int SortTranWalls(const void *a, const void *b)
+typedef struct
 {
-    vtxlist_t *xa = (vtxlist_t*)a;
-    vtxlist_t *xb = (vtxlist_t*)b;
+    unsigned int    key;
+    int             index;
+} dlsortkey_t;
+
+drawliststats_t drawliststats;
+
+static dlsortkey_t *sortkeys;
+static dlsortkey_t *sortkeystemp;
+static vtxlist_t *sortlist;
+static int maxsortkeys;
 
-    return xb->fparams - xa->fparams;
+//
+// DL_CheckSortBuffers
+//
+
+static void DL_CheckSortBuffers(const int count)
+{
+    if(count <= maxsortkeys)
+    {
+        return;
+    }
+
+    // grow in the same steps as the lists themselves
+    maxsortkeys = (count + 127) & ~127;
+
+    sortkeys = Z_Realloc(sortkeys, maxsortkeys * sizeof(dlsortkey_t), PU_STATIC, NULL);
+    sortkeystemp = Z_Realloc(sortkeystemp, maxsortkeys * sizeof(dlsortkey_t), PU_STATIC, NULL);
+    sortlist = Z_Realloc(sortlist, maxsortkeys * sizeof(vtxlist_t), PU_STATIC, NULL);
 }
 
-//=============================================================================
 //
-// Sorting
+// DL_FloatSortKey
 //
-// haleyjd 20140919: [SVE] mergesort, even a relatively naive implementation,
-// is an order of magnitude faster than libc qsort for sprites.
+// Maps a float onto an unsigned int that orders the same way
 //
-//=============================================================================
 
+static unsigned int DL_FloatSortKey(const float f)
+{
+    union
+    {
+        float           f;
+        unsigned int    u;
+    } bits;
+
+    bits.f = f;
+
+    if(bits.u & 0x80000000)
+    {
+        return ~bits.u;
+    }
+
+    return bits.u | 0x80000000;
+}
+
+//
+// DL_RadixSortKeys
 //
-// merge_sprite
+// Stable ascending sort of the first count sort keys, a byte per pass
 //
 
-void merge_sprite(vtxlist_t *list, vtxlist_t *aux, int left, int right, int rightEnd)
+static void DL_RadixSortKeys(const int count)
 {
-    int i, num, temp, leftEnd = right - 1;
-    temp = left;
-    num = rightEnd - left + 1;
+    int counts[256];
+    int shift;
+    int i;
 
-    while(left <= leftEnd && right <= rightEnd)
+    for(shift = 0; shift < 32; shift += 8)
     {
-        rbVisSprite_t *al = list[left].data;
-        rbVisSprite_t *ar = list[right].data;
+        dlsortkey_t *swap;
+        int offset;
 
-        if(al->dist > ar->dist)
+        memset(counts, 0, sizeof(counts));
+
+        for(i = 0; i < count; ++i)
         {
-            aux[temp++] = list[left++];
+            counts[(sortkeys[i].key >> shift) & 0xff]++;
         }
-        else
+
+        // nothing to do if every key landed in the same bucket
+        if(counts[(sortkeys[0].key >> shift) & 0xff] == count)
         {
-            aux[temp++] = list[right++];
+            continue;
         }
-    }
-    while(left <= leftEnd)
-    {
-        aux[temp++] = list[left++];
-    }
-    while(right <= rightEnd)
-    {
-        aux[temp++] = list[right++];
-    }
-    for(i = 1; i <= num; i++, rightEnd--)
-    {
-        list[rightEnd] = aux[rightEnd];
+
+        for(i = 0, offset = 0; i < 256; ++i)
+        {
+            int c = counts[i];
+
+            counts[i] = offset;
+            offset += c;
+        }
+
+        for(i = 0; i < count; ++i)
+        {
+            sortkeystemp[counts[(sortkeys[i].key >> shift) & 0xff]++] = sortkeys[i];
+        }
+
+        swap = sortkeys;
+        sortkeys = sortkeystemp;
+        sortkeystemp = swap;
     }
 }
 
 //
-// msort_sprite
+// DL_SortDrawList
+//
+// Sprites and translucent walls go back to front, everything else is
+// grouped by texture and params so DL_ProcessDrawList can batch it
 //
 
-void msort_sprite(vtxlist_t *list, vtxlist_t *temp, int left, int right)
+static void DL_SortDrawList(drawlist_t *dl, const int tag)
 {
-    int center;
+    uint64_t starttime;
+    int count = dl->index;
+    int i;
 
-    if(left < right)
+    if(count <= 1)
     {
-        center = (left+right) / 2;
-        msort_sprite(list, temp, left, center);
-        msort_sprite(list, temp, center+1, right);
-        merge_sprite(list, temp, left, center+1, right);
+        return;
     }
-}
 
-//
-// merge_wall
-//
-// Also for regular walls, it's worth it.
-//
+    starttime = I_GetTimeUS();
 
-void merge_wall(vtxlist_t *list, vtxlist_t *aux, int left, int right, int rightEnd)
-{
-    int i, num, temp, leftEnd = right - 1;
-    temp = left;
-    num = rightEnd - left + 1;
+    DL_CheckSortBuffers(count);
 
-    while(left <= leftEnd && right <= rightEnd)
+    switch(tag)
     {
-        if(list[left].texid > list[right].texid)
+    case DLT_SPRITE:
+    case DLT_SPRITEALPHA:
+    case DLT_SPRITEOUTLINE:
+        for(i = 0; i < count; ++i)
         {
-            aux[temp++] = list[left++];
+            rbVisSprite_t *vis = (rbVisSprite_t*)dl->list[i].data;
+
+            // flip the sign bit so signed distances order correctly,
+            // then invert for farthest first
+            sortkeys[i].key = ~((unsigned int)vis->dist ^ 0x80000000);
+            sortkeys[i].index = i;
         }
-        else
+        DL_RadixSortKeys(count);
+        break;
+
+    case DLT_TRANSWALL:
+        for(i = 0; i < count; ++i)
         {
-            aux[temp++] = list[right++];
+            sortkeys[i].key = ~DL_FloatSortKey(dl->list[i].fparams);
+            sortkeys[i].index = i;
         }
+        DL_RadixSortKeys(count);
+        break;
+
+    default:
+        // params is the minor key so it goes first
+        for(i = 0; i < count; ++i)
+        {
+            sortkeys[i].key = (unsigned int)dl->list[i].params;
+            sortkeys[i].index = i;
+        }
+        DL_RadixSortKeys(count);
+
+        for(i = 0; i < count; ++i)
+        {
+            sortkeys[i].key = (unsigned int)dl->list[sortkeys[i].index].texid;
+        }
+        DL_RadixSortKeys(count);
+        break;
     }
-    while(left <= leftEnd)
-    {
-        aux[temp++] = list[left++];
-    }
-    while(right <= rightEnd)
-    {
-        aux[temp++] = list[right++];
-    }
-    for(i = 1; i <= num; i++, rightEnd--)
+
+    for(i = 0; i < count; ++i)
     {
-        list[rightEnd] = aux[rightEnd];
+        sortlist[i] = dl->list[sortkeys[i].index];
     }
-}
 
-//
-// msort_wall
-//
+    memcpy(dl->list, sortlist, count * sizeof(vtxlist_t));
 
-void msort_wall(vtxlist_t *list, vtxlist_t *temp, int left, int right)
-{
-    if(left < right)
-    {
-        int center = (left+right) / 2;
-        msort_wall(list, temp, left, center);
-        msort_wall(list, temp, center+1, right);
-        merge_wall(list, temp, left, center+1, right);
-    }
+    drawliststats.sorted += count;
+    drawliststats.sort_us += (int)(I_GetTimeUS() - starttime);
 }
 
 //
@@ -219,25 +285,7 @@ void DL_ProcessDrawList(int tag)
     {
         if(tag != DLT_DYNLIGHT)
         {
-            if(tag != DLT_SPRITE && tag != DLT_SPRITEALPHA && tag != DLT_SPRITEOUTLINE)
-            {
-                if(tag == DLT_TRANSWALL)
-                {
-                    qsort(dl->list, dl->index, sizeof(vtxlist_t), SortTranWalls);
-                }
-                else
-                {
-                    vtxlist_t *temp = malloc(dl->index * sizeof(vtxlist_t));
-                    msort_wall(dl->list, temp, 0, dl->index - 1);
-                    free(temp);
-                }
-            }
-            else
-            {
-                vtxlist_t *temp = malloc(dl->index * sizeof(vtxlist_t));
-                msort_sprite(dl->list, temp, 0, dl->index - 1);
-                free(temp);
-            }
+            DL_SortDrawList(dl, tag);
         }
         
         tail = &dl->list[dl->index];
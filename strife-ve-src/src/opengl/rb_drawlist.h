@@ -21,7 +21,8 @@
 
 typedef enum
 {
-    DLF_CEILING = BIT(0)
+    DLF_CEILING         = BIT(0),
+    DLF_LIGHTCLUSTER    = BIT(1)    // [SVE]: see rb_dynlights.h
 } drawlistflag_e;
 
 typedef enum
@@ -68,6 +69,15 @@ typedef struct
 
 extern drawlist_t drawlist[NUMDRAWLISTS];
 
+// [SVE]: per-frame sort statistics, summed over every list sorted
+typedef struct
+{
+    int             sorted;     // entries sorted this frame
+    int             sort_us;    // time spent sorting them
+} drawliststats_t;
+
+extern drawliststats_t drawliststats;
+
 vtxlist_t *DL_AddVertexList(drawlist_t *dl);
 int DL_GetDrawListSize(int tag);
 void DL_BeginDrawList(void);
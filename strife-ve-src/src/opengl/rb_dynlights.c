@@ -20,17 +20,52 @@
 
 #include "doomstat.h"
 #include "rb_main.h"
+#include "rb_config.h"
 #include "rb_dynlights.h"
+#include "rb_shader.h"
 #include "rb_view.h"
 #include "p_local.h"
 #include "m_bbox.h"
+#include "m_misc.h"
 #include "r_defs.h"
 #include "r_state.h"
 #include "z_zone.h"
 
 static rbDynLight_t dynlightlist[MAX_DYNLIGHTS];
 static rbDynLight_t *dynlight = NULL;
-static unsigned int *markedssects;
+
+// [SVE]: lights touching each subsector, rebuilt every frame. A subsector
+// whose stamp isn't the current frame has no lights, so the chain heads
+// never need clearing.
+typedef struct
+{
+    int     light;
+    int     next;
+} rbLightBin_t;
+
+static int          *ssectbins;
+static unsigned int *ssectbinframe;
+static unsigned int binframe;
+static rbLightBin_t *lightbins;
+static int          numlightbins;
+static int          maxlightbins;
+
+// [SVE]: things whose current state gives off light. P_SpawnMobj,
+// P_SetMobjState and P_RemoveMobj keep this up to date, so finding the
+// lights doesn't mean walking every thinker each frame.
+static mobj_t       **lightemitters;
+static int          numlightemitters;
+static int          maxlightemitters;
+
+// [SVE]: single pass shader for the clustered path
+#ifndef GL_MAX_FRAGMENT_UNIFORM_COMPONENTS_ARB
+#define GL_MAX_FRAGMENT_UNIFORM_COMPONENTS_ARB  0x8B49
+#endif
+
+static rbShader_t   dynLightShader;
+static int          dynLightShaderMax;  // lights the shader's uniforms can hold
+static float        dynLightPos[MAX_DYNLIGHTS][4];
+static float        dynLightColor[MAX_DYNLIGHTS][4];
 
 typedef struct
 {
@@ -298,7 +333,8 @@ void RB_InitDynLights(void)
 void RB_ClearDynLights(void)
 {
     dynlight = dynlightlist;
-    memset(markedssects, 0, sizeof(unsigned int) * numsubsectors);
+    numlightbins = 0;
+    binframe++;
 }
 
 //
@@ -307,16 +343,83 @@ void RB_ClearDynLights(void)
 
 void RB_InitLightMarks(void)
 {
-    markedssects = (unsigned int*)Z_Calloc(1, sizeof(unsigned int) * numsubsectors, PU_LEVEL, 0);
+    ssectbins = (int*)Z_Malloc(sizeof(int) * numsubsectors, PU_LEVEL, 0);
+    ssectbinframe = (unsigned int*)Z_Calloc(1, sizeof(unsigned int) * numsubsectors, PU_LEVEL, 0);
+    binframe = 0;
+}
+
+//
+// RB_GetSubsectorLights
+//
+// Fills lights with the numbers of every light touching the subsector
+// and returns how many there are
+//
+
+int RB_GetSubsectorLights(const int num, byte *lights)
+{
+    int count = 0;
+    int bin;
+
+    if(ssectbinframe[num] != binframe)
+    {
+        return 0;
+    }
+
+    for(bin = ssectbins[num]; bin != -1; bin = lightbins[bin].next)
+    {
+        lights[count++] = (byte)lightbins[bin].light;
+    }
+
+    return count;
+}
+
+//
+// RB_ClearLightEmitters
+//
+// Things are freed wholesale at level setup without P_RemoveMobj
+//
+
+void RB_ClearLightEmitters(void)
+{
+    numlightemitters = 0;
 }
 
 //
-// RB_SubsectorMarked
+// RB_UpdateLightEmitter
+//
+// Call when a thing is spawned, removed or changes state. lightslot is
+// one past the thing's place in the emitter list, or 0 when it isn't on it.
 //
 
-unsigned int RB_SubsectorMarked(const int num)
+void RB_UpdateLightEmitter(mobj_t *mo)
 {
-    return markedssects[num];
+    boolean emits = false;
+
+    if(mo->thinker.function.acp1 == (actionf_p1)P_MobjThinker)
+    {
+        emits = (lightStates[mo->state - states].radius > 0);
+    }
+
+    if(emits && !mo->lightslot)
+    {
+        if(numlightemitters == maxlightemitters)
+        {
+            maxlightemitters = maxlightemitters ? maxlightemitters * 2 : 64;
+            lightemitters = Z_Realloc(lightemitters, maxlightemitters * sizeof(*lightemitters),
+                                      PU_STATIC, NULL);
+        }
+
+        lightemitters[numlightemitters++] = mo;
+        mo->lightslot = numlightemitters;
+    }
+    else if(!emits && mo->lightslot)
+    {
+        int slot = mo->lightslot - 1;
+
+        lightemitters[slot] = lightemitters[--numlightemitters];
+        lightemitters[slot]->lightslot = slot + 1;
+        mo->lightslot = 0;
+    }
 }
 
 //
@@ -350,7 +453,23 @@ void RB_ProcBSPDynLight(rbDynLight_t *light, int bspnum)
 
     if(bspnum & NF_SUBSECTOR)
     {
-        markedssects[bspnum & ~NF_SUBSECTOR] |= (1 << (light - dynlightlist));
+        int num = bspnum & ~NF_SUBSECTOR;
+
+        if(ssectbinframe[num] != binframe)
+        {
+            ssectbinframe[num] = binframe;
+            ssectbins[num] = -1;
+        }
+
+        if(numlightbins == maxlightbins)
+        {
+            maxlightbins = maxlightbins ? maxlightbins * 2 : 256;
+            lightbins = Z_Realloc(lightbins, maxlightbins * sizeof(*lightbins), PU_STATIC, NULL);
+        }
+
+        lightbins[numlightbins].light = light - dynlightlist;
+        lightbins[numlightbins].next = ssectbins[num];
+        ssectbins[num] = numlightbins++;
         return;
     }
 
@@ -382,92 +501,280 @@ const int RB_GetDynLightCount(void)
 
 void RB_AddDynLights(void)
 {
-    thinker_t *th;
     byte *vis;
     int s1;
     int s2;
+    int i;
+    int maxlights;
     
     RB_ClearDynLights();
 
-    s1 = (players[displayplayer].mo->subsector - subsectors);
+    // the shader can only see as many lights as its uniforms hold
+    maxlights = RB_UseDynLightShader() ? dynLightShaderMax : MAX_DYNLIGHTS;
+
+    s1 = (rbViewPlayer->mo->subsector - subsectors);
     vis = &pvsmatrix[(((numsubsectors + 7) / 8) * s1)];
 
-    for(th = thinkercap.next; th != &thinkercap; th = th->next)
+    for(i = 0; i < numlightemitters; i++)
     {
-        if(th->function.acp1 == (actionf_p1)P_MobjThinker)
+        mobj_t *mo = lightemitters[i];
+        rbLightState_t *lightState;
+        float x, y, z;
+
+        lightState = &lightStates[mo->state - states];
+
+        if(lightState->radius <= 0)
         {
-            mobj_t *mo = (mobj_t*)th;
-            rbLightState_t *lightState;
-            float x, y, z;
+            continue;
+        }
 
-            lightState = &lightStates[mo->state - states];
+        if(dynlight - dynlightlist >= maxlights)
+        {
+            return;
+        }
 
-            if(lightState->radius <= 0)
-            {
-                continue;
-            }
+        s2 = (mo->subsector - subsectors);
+        
+        if(!(vis[s2 >> 3] & (1 << (s2 & 7))))
+        {
+            continue;
+        }
+        
+        dynlight->x = FIXED2FLOAT(mo->x);
+        dynlight->y = FIXED2FLOAT(mo->y);
+        dynlight->z = FIXED2FLOAT(mo->z);
+
+        dynlight->radius = lightState->radius;
+        
+        x = rbPlayerView.x - dynlight->x;
+        y = rbPlayerView.y - dynlight->y;
+        z = rbPlayerView.z - dynlight->z;
+
+        if((x * x + y * y + z * z) > (dynlight->radius * dynlight->radius) * 128)
+        {
+            continue;
+        }
+        
+        dynlight->thing = mo;
+        dynlight->rgb[0] = lightState->r;
+        dynlight->rgb[1] = lightState->g;
+        dynlight->rgb[2] = lightState->b;
+        
+        dynlight->bbox[BOXTOP] = FLOAT2FIXED(dynlight->radius * 0.5f);
+        dynlight->bbox[BOXBOTTOM] = FLOAT2FIXED(-dynlight->radius * 0.5f);
+        dynlight->bbox[BOXRIGHT] = dynlight->bbox[BOXTOP];
+        dynlight->bbox[BOXLEFT] = dynlight->bbox[BOXBOTTOM];
+        
+        dynlight->bbox[BOXTOP] += mo->y;
+        dynlight->bbox[BOXBOTTOM] += mo->y;
+        dynlight->bbox[BOXRIGHT] += mo->x;
+        dynlight->bbox[BOXLEFT] += mo->x;
+        
+        if(mo->momx < 0)
+        {
+            dynlight->bbox[BOXLEFT] += (mo->momx-FRACUNIT);
+        }
+        else
+        {
+            dynlight->bbox[BOXRIGHT] += (mo->momx+FRACUNIT);
+        }
+        if(mo->momy < 0)
+        {
+            dynlight->bbox[BOXBOTTOM] += (mo->momy-FRACUNIT);
+        }
+        else
+        {
+            dynlight->bbox[BOXTOP] += (mo->momy+FRACUNIT);
+        }
 
-            if(dynlight - dynlightlist >= MAX_DYNLIGHTS)
-            {
-                return;
-            }
+        RB_ProcBSPDynLight(dynlight, numnodes-1);
+        dynlight++;
+    }
+}
 
-            s2 = (mo->subsector - subsectors);
-            
-            if(!(vis[s2 >> 3] & (1 << (s2 & 7))))
-            {
-                continue;
-            }
-            
-            dynlight->x = FIXED2FLOAT(mo->x);
-            dynlight->y = FIXED2FLOAT(mo->y);
-            dynlight->z = FIXED2FLOAT(mo->z);
+//=============================================================================
+//
+// Clustered Lighting
+//
+// Every lit wall and flat is drawn once per group of three lights instead
+// of once per light. The light numbers ride in the vertex color and the
+// surface normal in the texture coordinates (see RB_SetupDynLightCluster);
+// the shader works out what each light's point texture and fade would have
+// been and sums them. Only fast blend adds, so the regular blend still
+// gets one light per pass to scale the framebuffer once per light.
+//
+//=============================================================================
+
+static const char dynLightVertexProgram[] =
+    "varying vec3 vPos;\n"
+    "varying vec3 vNormal;\n"
+    "varying vec3 vLights;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vPos = gl_Vertex.xyz;\n"
+    "    vNormal = vec3(gl_MultiTexCoord0.xy, gl_Color.a * 2.0 - 1.0);\n"
+    "    vLights = gl_Color.rgb * 255.0;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+// MAXLIGHTS is defined ahead of this once the uniform limit is known
+static const char dynLightFragmentProgram[] =
+    "uniform sampler2D uLightTex;\n"
+    "uniform vec4 uLightPos[MAXLIGHTS];\n"
+    "uniform vec4 uLightColor[MAXLIGHTS];\n"
+    "uniform float uFastBlend;\n"
+    "\n"
+    "varying vec3 vPos;\n"
+    "varying vec3 vNormal;\n"
+    "varying vec3 vLights;\n"
+    "\n"
+    "vec3 sumLight;\n"
+    "vec3 mulLight;\n"
+    "\n"
+    "void AddLight(float slot, vec3 n, bool isFlat)\n"
+    "{\n"
+    "    int index = int(slot + 0.5);\n"
+    "    vec4 lp;\n"
+    "    vec3 d;\n"
+    "    vec2 uv;\n"
+    "    vec3 c;\n"
+    "    float dist;\n"
+    "\n"
+    "    if(index >= MAXLIGHTS)\n"
+    "        return;\n"
+    "\n"
+    "    lp = uLightPos[index];\n"
+    "    d = vPos - lp.xyz;\n"
+    "    dist = -dot(d, n) / (lp.w * 0.5);\n"
+    "\n"
+    "    if(dist < 0.0)\n"
+    "        return;\n"
+    "\n"
+    "    uv = isFlat ? d.xy : vec2(d.x * n.y - d.y * n.x, d.z);\n"
+    "    c = uLightColor[index].rgb * texture2D(uLightTex, uv / lp.w + 0.5).rgb;\n"
+    "\n"
+    "    sumLight += c * (1.0 - min(dist, 1.0));\n"
+    "    mulLight *= 1.0 + c;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    bool isFlat = abs(vNormal.z) > 0.5;\n"
+    "    vec3 n = isFlat ? vec3(0.0, 0.0, sign(vNormal.z)) : vec3(vNormal.xy, 0.0);\n"
+    "\n"
+    "    sumLight = vec3(0.0);\n"
+    "    mulLight = vec3(1.0);\n"
+    "\n"
+    "    AddLight(vLights.x, n, isFlat);\n"
+    "    AddLight(vLights.y, n, isFlat);\n"
+    "    AddLight(vLights.z, n, isFlat);\n"
+    "\n"
+    "    // fast blend adds each light faded by distance from the surface;\n"
+    "    // otherwise the framebuffer is scaled by (1 + light) for the one\n"
+    "    // light in the pass\n"
+    "    gl_FragColor = vec4(uFastBlend > 0.5 ? sumLight : mulLight - 1.0, 1.0);\n"
+    "}\n";
 
-            dynlight->radius = lightState->radius;
-            
-            x = rbPlayerView.x - dynlight->x;
-            y = rbPlayerView.y - dynlight->y;
-            z = rbPlayerView.z - dynlight->z;
+//
+// RB_InitDynLightShader
+//
 
-            if((x * x + y * y + z * z) > (dynlight->radius * dynlight->radius) * 128)
-            {
-                continue;
-            }
-            
-            dynlight->thing = mo;
-            dynlight->rgb[0] = lightState->r;
-            dynlight->rgb[1] = lightState->g;
-            dynlight->rgb[2] = lightState->b;
-            
-            dynlight->bbox[BOXTOP] = FLOAT2FIXED(dynlight->radius * 0.5f);
-            dynlight->bbox[BOXBOTTOM] = FLOAT2FIXED(-dynlight->radius * 0.5f);
-            dynlight->bbox[BOXRIGHT] = dynlight->bbox[BOXTOP];
-            dynlight->bbox[BOXLEFT] = dynlight->bbox[BOXBOTTOM];
-            
-            dynlight->bbox[BOXTOP] += mo->y;
-            dynlight->bbox[BOXBOTTOM] += mo->y;
-            dynlight->bbox[BOXRIGHT] += mo->x;
-            dynlight->bbox[BOXLEFT] += mo->x;
-            
-            if(mo->momx < 0)
-            {
-                dynlight->bbox[BOXLEFT] += (mo->momx-FRACUNIT);
-            }
-            else
-            {
-                dynlight->bbox[BOXRIGHT] += (mo->momx+FRACUNIT);
-            }
-            if(mo->momy < 0)
-            {
-                dynlight->bbox[BOXBOTTOM] += (mo->momy-FRACUNIT);
-            }
-            else
-            {
-                dynlight->bbox[BOXTOP] += (mo->momy+FRACUNIT);
-            }
+void RB_InitDynLightShader(void)
+{
+    GLint components = 0;
+    char *fragment;
+    size_t len;
 
-            RB_ProcBSPDynLight(dynlight, numnodes-1);
-            dynlight++;
-        }
+    if(!has_GL_ARB_shader_objects)
+    {
+        return;
+    }
+
+    // two vec4 uniforms per light plus uFastBlend
+    dglGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_COMPONENTS_ARB, &components);
+    dynLightShaderMax = MIN(MAX_DYNLIGHTS, (components / 4 - 1) / 2);
+
+    if(dynLightShaderMax < DYNLIGHT_PASSLIGHTS)
+    {
+        fprintf(stderr, "RB_InitDynLightShader: only %i fragment uniform components, "
+                        "using multipass lights\n", components);
+        return;
+    }
+
+    len = strlen(dynLightFragmentProgram) + 32;
+    fragment = (char*)Z_Malloc(len, PU_STATIC, NULL);
+    M_snprintf(fragment, len, "#define MAXLIGHTS %i\n\n%s",
+               dynLightShaderMax, dynLightFragmentProgram);
+
+    SP_LoadProgramText(&dynLightShader, dynLightVertexProgram, fragment);
+    Z_Free(fragment);
+}
+
+//
+// RB_ShutdownDynLightShader
+//
+
+void RB_ShutdownDynLightShader(void)
+{
+    SP_Delete(&dynLightShader);
+}
+
+//
+// RB_UseDynLightShader
+//
+// False falls back to redrawing every surface once per light
+//
+
+boolean RB_UseDynLightShader(void)
+{
+    return rbDynamicLightShader && dynLightShader.bLoaded && !dynLightShader.bHasErrors;
+}
+
+//
+// RB_BeginDynLightShader
+//
+// Expects the light point texture bound to unit 0
+//
+
+void RB_BeginDynLightShader(void)
+{
+    int count = RB_GetDynLightCount();
+    int i;
+
+    if(!RB_UseDynLightShader() || count == 0)
+    {
+        return;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        dynLightPos[i][0] = dynlightlist[i].x;
+        dynLightPos[i][1] = dynlightlist[i].y;
+        dynLightPos[i][2] = dynlightlist[i].z;
+        dynLightPos[i][3] = dynlightlist[i].radius;
+
+        dynLightColor[i][0] = dynlightlist[i].rgb[0] / 255.0f;
+        dynLightColor[i][1] = dynlightlist[i].rgb[1] / 255.0f;
+        dynLightColor[i][2] = dynlightlist[i].rgb[2] / 255.0f;
+        dynLightColor[i][3] = 1.0f;
+    }
+
+    SP_Enable(&dynLightShader);
+    SP_SetUniform1i(&dynLightShader, "uLightTex", 0);
+    SP_SetUniform1f(&dynLightShader, "uFastBlend", rbDynamicLightFastBlend ? 1.0f : 0.0f);
+    SP_SetUniform4fv(&dynLightShader, "uLightPos", count, &dynLightPos[0][0]);
+    SP_SetUniform4fv(&dynLightShader, "uLightColor", count, &dynLightColor[0][0]);
+}
+
+//
+// RB_EndDynLightShader
+//
+
+void RB_EndDynLightShader(void)
+{
+    if(RB_UseDynLightShader())
+    {
+        RB_DisableShaders();
     }
 }
@@ -16,7 +16,16 @@
 #ifndef __RB_DYNLIGHTS_H__
 #define __RB_DYNLIGHTS_H__
 
-#define MAX_DYNLIGHTS   32
+#define MAX_DYNLIGHTS   128
+
+// [SVE]: a clustered light pass carries up to DYNLIGHT_PASSLIGHTS light
+// numbers in its draw list flags, eight bits each from DYNLIGHT_FLAGSHIFT
+// up; DYNLIGHT_NONE marks an empty slot
+#define DYNLIGHT_PASSLIGHTS     3
+#define DYNLIGHT_FLAGSHIFT      4
+#define DYNLIGHT_NONE           0xff
+#define DYNLIGHT_PASSLIGHT(flags, n) \
+    (((flags) >> (DYNLIGHT_FLAGSHIFT + (n) * 8)) & 0xff)
 
 typedef struct
 {
@@ -34,6 +43,13 @@ void RB_InitLightMarks(void);
 const int RB_GetDynLightCount(void);
 void RB_AddDynLights(void);
 rbDynLight_t *RB_GetDynLight(const int num);
-unsigned int RB_SubsectorMarked(const int num);
+int RB_GetSubsectorLights(const int num, byte *lights);
+void RB_ClearLightEmitters(void);
+void RB_UpdateLightEmitter(mobj_t *mo);
+void RB_InitDynLightShader(void);
+void RB_ShutdownDynLightShader(void);
+boolean RB_UseDynLightShader(void);
+void RB_BeginDynLightShader(void);
+void RB_EndDynLightShader(void);
 
 #endif
@@ -1374,16 +1374,64 @@ boolean RB_GenerateLightMapFlat(vtxlist_t *vl, int *drawcount)
 //
 //=============================================================================
 
+//
+// RB_SetupDynLightCluster
+//
+// For the clustered light shader: RGB holds up to three light numbers,
+// the texture coordinates the XY normal and alpha its Z (0 for ceilings,
+// 255 for floors, 128 for walls)
+//
+
+static void RB_SetupDynLightCluster(vtx_t *v, int count, float nx, float ny, byte nz, int flags)
+{
+    int i;
+
+    for(i = 0; i < count; ++i)
+    {
+        v[i].tu = nx;
+        v[i].tv = ny;
+        v[i].r = DYNLIGHT_PASSLIGHT(flags, 0);
+        v[i].g = DYNLIGHT_PASSLIGHT(flags, 1);
+        v[i].b = DYNLIGHT_PASSLIGHT(flags, 2);
+        v[i].a = nz;
+    }
+}
+
+//
+// RB_GetDynLightSeg
+//
+// Per-light lists carry the light and a seg number; clustered ones the
+// seg itself
+//
+
+static seg_t *RB_GetDynLightSeg(vtxlist_t *vl, rbDynLight_t **light)
+{
+    if(vl->flags & DLF_LIGHTCLUSTER)
+    {
+        *light = NULL;
+        return (seg_t*)vl->data;
+    }
+
+    *light = (rbDynLight_t*)vl->data;
+    return &segs[vl->params];
+}
+
 //
 // RB_SetupDynLightWall
 //
 // Maps texture coordinates and sets up RGB values for dynlight
 //
 
-static void RB_SetupDynLightWall(vtx_t *v, seg_t *seg, rbDynLight_t *light)
+static void RB_SetupDynLightWall(vtx_t *v, seg_t *seg, rbDynLight_t *light, int flags)
 {
     float d1, d2, dz;
     float dist;
+
+    if(light == NULL)
+    {
+        RB_SetupDynLightCluster(v, 4, seg->linedef->fnx, seg->linedef->fny, 128, flags);
+        return;
+    }
     
     dz = ((v[0].z - light->z) / light->radius) + 0.5f;
     
@@ -1444,14 +1492,7 @@ boolean RB_GenerateDynLightLowerSeg(vtxlist_t *vl, int *drawcount)
     seg_t           *seg;
     rbDynLight_t    *light;
     
-    light = (rbDynLight_t*)vl->data;
-    
-    if(!light)
-    {
-        return false;
-    }
-    
-    seg = &segs[vl->params];
+    seg = RB_GetDynLightSeg(vl, &light);
     
     v = &drawVertex[*drawcount];
     
@@ -1473,7 +1514,7 @@ boolean RB_GenerateDynLightLowerSeg(vtxlist_t *vl, int *drawcount)
         v[0].z = v[1].z = bbottom;
         v[2].z = v[3].z = bottom;
         
-        RB_SetupDynLightWall(v, seg, light);
+        RB_SetupDynLightWall(v, seg, light, vl->flags);
         
         RB_AddTriangle(*drawcount + 0, *drawcount + 1, *drawcount + 2);
         RB_AddTriangle(*drawcount + 3, *drawcount + 2, *drawcount + 1);
@@ -1499,14 +1540,7 @@ boolean RB_GenerateDynLightUpperSeg(vtxlist_t *vl, int *drawcount)
     seg_t           *seg;
     rbDynLight_t    *light;
     
-    light = (rbDynLight_t*)vl->data;
-    
-    if(!light)
-    {
-        return false;
-    }
-    
-    seg = &segs[vl->params];
+    seg = RB_GetDynLightSeg(vl, &light);
     
     v = &drawVertex[*drawcount];
     
@@ -1528,7 +1562,7 @@ boolean RB_GenerateDynLightUpperSeg(vtxlist_t *vl, int *drawcount)
         v[0].z = v[1].z = top;
         v[2].z = v[3].z = btop;
         
-        RB_SetupDynLightWall(v, seg, light);
+        RB_SetupDynLightWall(v, seg, light, vl->flags);
         
         RB_AddTriangle(*drawcount + 0, *drawcount + 1, *drawcount + 2);
         RB_AddTriangle(*drawcount + 3, *drawcount + 2, *drawcount + 1);
@@ -1554,14 +1588,7 @@ boolean RB_GenerateDynLightMiddleSeg(vtxlist_t *vl, int *drawcount)
     seg_t           *seg;
     rbDynLight_t    *light;
     
-    light = (rbDynLight_t*)vl->data;
-    
-    if(!light)
-    {
-        return false;
-    }
-    
-    seg = &segs[vl->params];
+    seg = RB_GetDynLightSeg(vl, &light);
     
     v = &drawVertex[*drawcount];
     
@@ -1595,7 +1622,7 @@ boolean RB_GenerateDynLightMiddleSeg(vtxlist_t *vl, int *drawcount)
     v[0].z = v[1].z = top;
     v[2].z = v[3].z = bottom;
     
-    RB_SetupDynLightWall(v, seg, light);
+    RB_SetupDynLightWall(v, seg, light, vl->flags);
     
     RB_AddTriangle(*drawcount + 0, *drawcount + 1, *drawcount + 2);
     RB_AddTriangle(*drawcount + 3, *drawcount + 2, *drawcount + 1);
@@ -1624,20 +1651,21 @@ boolean RB_GenerateDynLightFlat(vtxlist_t *vl, int *drawcount)
     float           dist;
     float           height;
     
-    light = (rbDynLight_t*)vl->data;
-    
-    if(!light)
+    if(vl->flags & DLF_LIGHTCLUSTER)
     {
-        return false;
+        light   = NULL;
+        ss      = (subsector_t*)vl->data;
+    }
+    else
+    {
+        light   = (rbDynLight_t*)vl->data;
+        ss      = &subsectors[vl->params];
     }
     
-    ss          = &subsectors[vl->params];
     leaf        = &leafs[ss->leaf];
     sector      = ss->sector;
     count       = *drawcount;
     startVtx    = NULL;
-    x           = light->x;
-    y           = light->y;
     
     for(j = 0; j < ss->numleafs - 2; ++j)
     {
@@ -1647,6 +1675,35 @@ boolean RB_GenerateDynLightFlat(vtxlist_t *vl, int *drawcount)
     height = (vl->flags & DLF_CEILING) ? FIXED2FLOAT(sector->ceilingheight) :
                                          FIXED2FLOAT(sector->floorheight);
 
+    if(light == NULL)
+    {
+        for(j = 0; j < ss->numleafs; ++j)
+        {
+            vtx_t *v = &drawVertex[count++];
+
+            if(vl->flags & DLF_CEILING)
+            {
+                leaf = &leafs[(ss->leaf + (ss->numleafs - 1)) - j];
+            }
+            else
+            {
+                leaf = &leafs[ss->leaf + j];
+            }
+
+            v->x = leaf->vertex->fx;
+            v->y = leaf->vertex->fy;
+            v->z = height;
+        }
+
+        RB_SetupDynLightCluster(&drawVertex[*drawcount], ss->numleafs, 0, 0,
+                                (vl->flags & DLF_CEILING) ? 0 : 255, vl->flags);
+
+        *drawcount = count;
+        return true;
+    }
+
+    x = light->x;
+    y = light->y;
     dist = (light->z - height) / (light->radius * 0.5f);
 
     if(vl->flags & DLF_CEILING)
@@ -24,47 +24,18 @@
 #include "rb_draw.h"
 #include "r_defs.h"
 #include "r_state.h"
+#include "z_zone.h"
 
-//
-// RB_GetLightGridIndex
-//
-
-int RB_GetLightGridIndex(fixed_t x, fixed_t y, fixed_t z)
-{
-    int idx;
-    int i;
-    int origin[3];
-    int pos[3];
-    float size[3];
-
-    for(i = 0; i < 3; ++i)
-    {
-        size[i] = MAX(floorf(((float)lightgrid.blockSize[i] / (float)lightgrid.gridSize[i]) * 2.0f), 1);
-    }
-
-    // try to convert the origin to local coordinates
-    origin[0] = (x >> FRACBITS) - (lightgrid.min[0] - (lightgrid.blockSize[0] / size[0]));
-    origin[1] = (y >> FRACBITS) - (lightgrid.min[1] - (lightgrid.blockSize[1] / size[1]));
-    origin[2] = (z >> FRACBITS) - (lightgrid.min[2] - (lightgrid.blockSize[2] / size[2]));
-
-    for(i = 0; i < 3; ++i)
-    {
-        // determine what grid we're standing in
-        pos[i] = MIN(MAX(floorf(origin[i] * lightgrid.gridUnit[i]), 0), lightgrid.blockSize[i]-1);
-    }
-
-    // convert to grid cell index
-    idx = pos[0] +
-          pos[1] * lightgrid.blockSize[0] +
-          pos[2] * (lightgrid.blockSize[0] * lightgrid.blockSize[1]);
+// [SVE]: grid metrics and per-cell lookups worked out once per level by
+// RB_InitLightGrid, instead of on every sprite vertex
+static float    gridBase[3];
+static int      *gridCells[2];      // cell to sample, indexed by insky
+static byte     *gridCellMix;       // which lightGridMix table a cell uses
 
-    if((idx < 0 || idx >= lightgrid.count) || lightgrid.bits[idx] == 0)
-    {
-        return -1;
-    }
-
-    return idx;
-}
+// RB_ApplyLightGridRGB's colour math for every vertex/cell channel pair,
+// indexed by cell type
+static byte     lightGridMix[NUMLIGHTGRIDTYPES][256][256];
+static boolean  lightGridMixReady;
 
 //
 // RB_OverrideNeighborCell
@@ -101,74 +72,142 @@ static int RB_OverrideNeighborCell(int index, rbLightGridType_t checkType)
 }
 
 //
-// RB_ApplyLightGridRGB
+// RB_InitLightGridMix
 //
 
-void RB_ApplyLightGridRGB(vtx_t *vtx, int index, boolean insky)
+static void RB_InitLightGridMix(void)
 {
-    byte *rgb;
-    float r, g, b;
-    float r1, r2;
-    float g1, g2;
-    float b1, b2;
+    int c1, c2;
+    float r, r1, r2;
 
-    if(index <= -1)
+    for(c1 = 0; c1 < 256; ++c1)
+    {
+        for(c2 = 0; c2 < 256; ++c2)
+        {
+            r1 = (float)c1 / 255.0f;
+            r2 = (float)c2 / 255.0f;
+
+            // sun types lerps half the sun color to the vertex color
+            lightGridMix[LGT_SUN][c1][c2] = (byte)(((r2 - r1) * 0.5f + r1) * 255.0f);
+
+            // mix colors together
+            r = MIN((r1 + ((MIN((r1 * r2) + r2, 1))) / 2), 1);
+            lightGridMix[LGT_NONE][c1][c2] = (byte)(r * 255.0f);
+
+            // sunshade types lerps color to a slightly darker shade first
+            r1 = (((c1>>1) / 255.0f) - r1) * 0.635f + r1;
+            r = MIN((r1 + ((MIN((r1 * r2) + r2, 1))) / 2), 1);
+            lightGridMix[LGT_SUNSHADE][c1][c2] = (byte)(r * 255.0f);
+        }
+    }
+
+    lightGridMixReady = true;
+}
+
+//
+// RB_InitLightGrid
+//
+// Call once the level's light grid is loaded
+//
+
+void RB_InitLightGrid(void)
+{
+    int i;
+    float size;
+
+    if(!lightGridMixReady)
+    {
+        RB_InitLightGridMix();
+    }
+
+    if(lightgrid.count <= 0)
     {
         return;
     }
-    
-    // some cells that aren't in shade may still overlap sectors with
-    // a sky flat, which results in sudden 'flickering' of
-    // the lightlevel brightness when moving between a shaded cell and
-    // a normal cell. this checks for surrounding cells that are in shade
-    // so we can appropriately avoid this glitch
-    if(insky && lightgrid.types[index] == LGT_NONE)
+
+    for(i = 0; i < 3; ++i)
     {
-        // if standing in a sky sector but cell isn't shaded, then
-        // look for neighbor cells that is a shade type
-        index = RB_OverrideNeighborCell(index, LGT_SUNSHADE);
+        size = MAX(floorf(((float)lightgrid.blockSize[i] / (float)lightgrid.gridSize[i]) * 2.0f), 1);
+        gridBase[i] = lightgrid.min[i] - (lightgrid.blockSize[i] / size);
     }
-    else if(!insky && lightgrid.types[index] == LGT_SUNSHADE)
+
+    gridCells[0] = Z_Malloc(lightgrid.count * sizeof(int), PU_LEVEL, &gridCells[0]);
+    gridCells[1] = Z_Malloc(lightgrid.count * sizeof(int), PU_LEVEL, &gridCells[1]);
+    gridCellMix = Z_Malloc(lightgrid.count, PU_LEVEL, &gridCellMix);
+
+    for(i = 0; i < lightgrid.count; ++i)
     {
-        // if not standing in a sky sector but cell is shaded, then
-        // look for neighbor cells that isn't a shade type
-        index = RB_OverrideNeighborCell(index, LGT_NONE);
+        // some cells that aren't in shade may still overlap sectors with
+        // a sky flat, which results in sudden 'flickering' of
+        // the lightlevel brightness when moving between a shaded cell and
+        // a normal cell. this checks for surrounding cells that are in shade
+        // so we can appropriately avoid this glitch
+        gridCells[0][i] = (lightgrid.types[i] == LGT_SUNSHADE) ?
+                          RB_OverrideNeighborCell(i, LGT_NONE) : i;
+        gridCells[1][i] = (lightgrid.types[i] == LGT_NONE) ?
+                          RB_OverrideNeighborCell(i, LGT_SUNSHADE) : i;
+
+        gridCellMix[i] = (lightgrid.types[i] < NUMLIGHTGRIDTYPES) ?
+                         lightgrid.types[i] : LGT_NONE;
     }
-    
-    rgb = lightgrid.rgb + (index * 3);
-    
-    r1 = (float)vtx->r / 255.0f;
-    g1 = (float)vtx->g / 255.0f;
-    b1 = (float)vtx->b / 255.0f;
-    
-    r2 = (float)rgb[0] / 255.0f;
-    g2 = (float)rgb[1] / 255.0f;
-    b2 = (float)rgb[2] / 255.0f;
+}
+
+//
+// RB_GetLightGridIndex
+//
 
-    if(lightgrid.types[index] == LGT_SUNSHADE)
+int RB_GetLightGridIndex(fixed_t x, fixed_t y, fixed_t z)
+{
+    int idx;
+    int i;
+    int origin[3];
+    int pos[3];
+
+    // try to convert the origin to local coordinates
+    origin[0] = (x >> FRACBITS) - gridBase[0];
+    origin[1] = (y >> FRACBITS) - gridBase[1];
+    origin[2] = (z >> FRACBITS) - gridBase[2];
+
+    for(i = 0; i < 3; ++i)
     {
-        // sunshade types lerps color to a slightly darker shade
-        r1 = (((vtx->r>>1) / 255.0f) - r1) * 0.635f + r1;
-        g1 = (((vtx->g>>1) / 255.0f) - g1) * 0.635f + g1;
-        b1 = (((vtx->b>>1) / 255.0f) - b1) * 0.635f + b1;
+        // determine what grid we're standing in
+        pos[i] = MIN(MAX(floorf(origin[i] * lightgrid.gridUnit[i]), 0), lightgrid.blockSize[i]-1);
     }
-    else if(lightgrid.types[index] == LGT_SUN)
+
+    // convert to grid cell index
+    idx = pos[0] +
+          pos[1] * lightgrid.blockSize[0] +
+          pos[2] * (lightgrid.blockSize[0] * lightgrid.blockSize[1]);
+
+    if((idx < 0 || idx >= lightgrid.count) || lightgrid.bits[idx] == 0)
+    {
+        return -1;
+    }
+
+    return idx;
+}
+
+//
+// RB_ApplyLightGridRGB
+//
+
+void RB_ApplyLightGridRGB(vtx_t *vtx, int index, boolean insky)
+{
+    byte *rgb;
+    byte (*mix)[256];
+
+    if(index <= -1)
     {
-        // sun types lerps half the sun color to the vertex color
-        vtx->r = (byte)(((r2 - r1) * 0.5f + r1) * 255.0f);
-        vtx->g = (byte)(((g2 - g1) * 0.5f + g1) * 255.0f);
-        vtx->b = (byte)(((b2 - b1) * 0.5f + b1) * 255.0f);
         return;
     }
 
-    // mix colors together
-    r = MIN((r1 + ((MIN((r1 * r2) + r2, 1))) / 2), 1);
-    g = MIN((g1 + ((MIN((g1 * g2) + g2, 1))) / 2), 1);
-    b = MIN((b1 + ((MIN((b1 * b2) + b2, 1))) / 2), 1);
+    index = gridCells[insky != false][index];
+    rgb = lightgrid.rgb + (index * 3);
+    mix = lightGridMix[gridCellMix[index]];
 
-    vtx->r = (byte)(r * 255.0f);
-    vtx->g = (byte)(g * 255.0f);
-    vtx->b = (byte)(b * 255.0f);
+    vtx->r = mix[vtx->r][rgb[0]];
+    vtx->g = mix[vtx->g][rgb[1]];
+    vtx->b = mix[vtx->b][rgb[2]];
 }
 
 //
@@ -16,6 +16,7 @@
 #ifndef __RB_LIGHTGRID_H__
 #define __RB_LIGHTGRID_H__
 
+void RB_InitLightGrid(void);
 int RB_GetLightGridIndex(fixed_t x, fixed_t y, fixed_t z);
 void RB_ApplyLightGridRGB(vtx_t *vtx, int index, boolean insky);
 void RB_DrawLightGridCell(int index);
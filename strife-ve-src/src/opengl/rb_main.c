@@ -24,12 +24,23 @@
 #include "rb_draw.h"
 #include "rb_drawlist.h"
 #include "rb_hudtext.h"
+#include "rb_shader.h"
+#include "rb_occlusion.h"
+#include "rb_wallshade.h"
+#include "rb_view.h"
 #include "rb_config.h"
 #include "i_system.h"
 #include "i_video.h"
 #include "m_misc.h"
 #include "m_argv.h"
 #include "r_state.h"
+#include "r_data.h"
+#include "r_things.h"
+#include "doomstat.h"
+#include "i_sound.h"
+#include "i_capture.h"
+#include "i_ffmpeg.h"
+#include "s_sound.h"
 
 static int          viewWidth;
 static int          viewHeight;
@@ -88,6 +99,7 @@ void RB_Shutdown(void)
     RB_DeleteData();
     RB_HudTextShutdown();
     RB_ShutdownDrawer();
+    RB_ShutdownViews();
 }
 
 //
@@ -207,6 +219,9 @@ void RB_SetMaxOrtho(int sw, int sh)
 //
 // RB_PointToAngle
 //
+// [SVE]: deliberately left on the slope table. It's one division and a
+// lookup, and sprite rotation and seg angles depend on its exact values.
+//
 
 angle_t RB_PointToAngle(fixed_t x, fixed_t y)
 {
@@ -293,6 +308,9 @@ angle_t RB_PointToAngle(fixed_t x, fixed_t y)
 //
 // Same as RB_PointToAngle but more precise
 //
+// [SVE]: returns a pseudo-angle that only has to keep the order of real
+// angles for the clipper; one division, nothing to tabulate
+//
 
 angle_t RB_PointToBam(fixed_t x, fixed_t y)
 {
@@ -332,12 +350,62 @@ void RB_SwapBuffers(void)
     {
         RB_Printf(0, 0, "State Changes: %i", rbState.numStateChanges);
         RB_Printf(0, 12, "Texture Binds: %i", rbState.numTextureBinds);
+        RB_Printf(0, 24, "Program switches: %i uniforms sent: %i skipped: %i",
+                  shaderstats.switches, shaderstats.uploads, shaderstats.skipped);
 
         RB_Printf(0, 36, "Wall list size: %i", DL_GetDrawListSize(DLT_WALL));
         RB_Printf(0, 48, "Flat list size: %i", DL_GetDrawListSize(DLT_FLAT));
         RB_Printf(0, 60, "Sprite list size: %i", DL_GetDrawListSize(DLT_SPRITE));
+        RB_Printf(0, 72, "Occlusion queries: %i culled subsectors: %i subtrees: %i",
+                  occlusionstats.queries, occlusionstats.culled, occlusionstats.nodes);
         
         RB_Printf(0, 84, "Drawn Vertices: %i", rbState.numDrawnVertices);
+        RB_Printf(0, 96, "Shade colors from tables: %i converted: %i",
+                  shadestats.lookups, shadestats.computed);
+
+        RB_Printf(0, 108, "Sounds played: %i culled: %i no channel: %i",
+                  soundstats.played, soundstats.culled, soundstats.nochannel);
+        RB_Printf(0, 120, "Sound spatial hits: %i misses: %i",
+                  soundstats.spatialhits, soundstats.spatialmisses);
+        RB_Printf(0, 132, "Mixer slice: %ius jitter avg: %ius max: %ius",
+                  audiostats.slice_us, audiostats.avgjitter_us,
+                  audiostats.maxjitter_us);
+
+        if(!use3drenderer)
+        {
+            RB_Printf(0, 156, "Vissprites: %i arena: %u sort: %ius",
+                      spritestats.visible, maxvissprites, spritestats.sort_us);
+
+            if(!avstats.playing)
+            {
+                RB_Printf(0, 168, "Composites: %i (%iK) built: %ius threads: %i lazy: %i",
+                          compositestats.textures, compositestats.bytes >> 10,
+                          compositestats.build_us, compositestats.threads,
+                          compositestats.lazybuilds);
+            }
+        }
+        else
+        {
+            RB_Printf(0, 156, "Draw list sort: %i entries %ius",
+                      drawliststats.sorted, drawliststats.sort_us);
+        }
+
+        if(avstats.playing)
+        {
+            RB_Printf(0, 168, "Movie queue max packets: %i audio: %i frames: %i",
+                      avstats.maxvideopackets, avstats.maxaudiochunks,
+                      avstats.maxvideoframes);
+            RB_Printf(0, 180, "Movie underruns video: %i audio: %i demux stalls: %i",
+                      avstats.videounderruns, avstats.audiounderruns,
+                      avstats.demuxstalls);
+        }
+
+        if(capturestats.active)
+        {
+            RB_Printf(0, 192, "Capture frames: %i dropped: %i audio dropped: %i",
+                      capturestats.frames, capturestats.dropped,
+                      capturestats.audiodropped);
+        }
     }
 
     if(rbForceSync)
@@ -352,6 +420,14 @@ void RB_SwapBuffers(void)
     rbState.numStateChanges = 0;
     rbState.numTextureBinds = 0;
     rbState.numDrawnVertices = 0;
+    memset(&soundstats, 0, sizeof(soundstats));
+    memset(&shaderstats, 0, sizeof(shaderstats));
+    memset(&occlusionstats, 0, sizeof(occlusionstats));
+    memset(&shadestats, 0, sizeof(shadestats));
+    memset(&drawliststats, 0, sizeof(drawliststats));
+
+    // [SVE]: pick up -shaderdir edits between frames
+    SP_CheckReload();
 }
 
 //
@@ -789,6 +865,7 @@ void RB_DisableShaders(void)
     {
         dglUseProgramObjectARB(0);
         rbState.currentProgram = 0;
+        shaderstats.switches++;
     }
 }
 
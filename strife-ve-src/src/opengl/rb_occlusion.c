@@ -0,0 +1,488 @@
+//
+// Copyright(C) 2014 Night Dive Studios, Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//    Subsector and BSP node occlusion culling with hardware occlusion
+//    queries
+//
+//    Subsectors reached by the BSP walk have their bounding box tested
+//    against the depth buffer once the opaque walls and flats are down.
+//    Results are picked up at the start of the next frame, so nothing
+//    ever waits on the GPU. A subsector whose box came back with no
+//    samples several frames running has its walls and flats left out of
+//    the draw lists. It keeps being tested every frame.
+//
+//    A node whose walked subsectors were all culled has its own box
+//    tested, and while that comes back empty the walk skips the node's
+//    whole subtree, testing just the one box in its place.
+//
+//    Anything culled is only seen again a frame after it shows, so the
+//    boxes are tested a little larger than they are. Geometry moving
+//    into view then usually reaches the grown box a frame before it
+//    reaches the screen.
+//
+
+#include "rb_main.h"
+#include "rb_occlusion.h"
+#include "rb_config.h"
+#include "rb_draw.h"
+#include "rb_texture.h"
+#include "rb_view.h"
+#include "r_defs.h"
+#include "r_state.h"
+#include "r_main.h"
+#include "m_bbox.h"
+#include "z_zone.h"
+
+#ifndef GL_SAMPLES_PASSED_ARB
+#define GL_SAMPLES_PASSED_ARB           0x8914
+#endif
+
+#ifndef GL_QUERY_RESULT_ARB
+#define GL_QUERY_RESULT_ARB             0x8866
+#endif
+
+#ifndef GL_QUERY_RESULT_AVAILABLE_ARB
+#define GL_QUERY_RESULT_AVAILABLE_ARB   0x8867
+#endif
+
+// consecutive hidden results before a subsector is culled
+#define OCCLUSION_HIDDENFRAMES  2
+
+// subsectors that were visible are only retested every fourth frame
+#define OCCLUSION_RETESTMASK    3
+
+// query boxes are grown by this much on every side, more than the
+// view moves in a frame
+#define OCCLUSION_REVEALMARGIN  (32*FRACUNIT)
+
+// grown boxes the view is this close to are never tested, the near
+// plane could cut into them
+#define OCCLUSION_NEARMARGIN    (16*FRACUNIT)
+
+typedef struct
+{
+    fixed_t         bbox[4];
+    fixed_t         floorz;         // height range to test
+    fixed_t         ceilingz;
+    unsigned int    heightframe;    // frame a node's height range was gathered
+    unsigned int    resultframe;    // frame the last query result was read
+    unsigned int    queryframe;     // frame the box was last queued
+    byte            hidden;         // consecutive results with no samples
+} occlusionbox_t;
+
+occlusionstats_t occlusionstats;
+
+static occlusionbox_t *occlusionssects;
+static occlusionbox_t *occlusionnodes;
+static occlusionbox_t **queryboxes;
+static int numqueryboxes;
+static GLuint *queryids;
+static int numqueryids;
+static unsigned int occlusionframe;
+static boolean occlusionsuspended;
+
+// subsectors the walk has reached so far this frame that are drawn,
+// and that are culled or inside a skipped node
+static int walkdrawn;
+static int walkculled;
+
+//
+// RB_InitOcclusion
+//
+// Called at level setup once the leafs have been built
+//
+
+void RB_InitOcclusion(void)
+{
+    int i, j;
+
+    occlusionssects = (occlusionbox_t*)Z_Calloc(numsubsectors, sizeof(occlusionbox_t),
+                                                PU_LEVEL, (void**)&occlusionssects);
+    occlusionnodes = (occlusionbox_t*)Z_Calloc(MAX(numnodes, 1), sizeof(occlusionbox_t),
+                                               PU_LEVEL, (void**)&occlusionnodes);
+    queryboxes = (occlusionbox_t**)Z_Malloc((numsubsectors + numnodes) * sizeof(occlusionbox_t*),
+                                            PU_LEVEL, (void**)&queryboxes);
+    numqueryboxes = 0;
+
+    for(i = 0; i < numsubsectors; ++i)
+    {
+        subsector_t *sub = &subsectors[i];
+        occlusionbox_t *occ = &occlusionssects[i];
+
+        M_ClearBox(occ->bbox);
+
+        for(j = 0; j < sub->numleafs; ++j)
+        {
+            vertex_t *vertex = leafs[sub->leaf + j].vertex;
+            M_AddToBox(occ->bbox, vertex->x, vertex->y);
+        }
+    }
+
+    for(i = 0; i < numnodes; ++i)
+    {
+        node_t *node = &nodes[i];
+        occlusionbox_t *occ = &occlusionnodes[i];
+
+        M_ClearBox(occ->bbox);
+
+        for(j = 0; j < 2; ++j)
+        {
+            M_AddToBox(occ->bbox, node->bbox[j][BOXLEFT], node->bbox[j][BOXBOTTOM]);
+            M_AddToBox(occ->bbox, node->bbox[j][BOXRIGHT], node->bbox[j][BOXTOP]);
+        }
+    }
+}
+
+//
+// RB_OcclusionActive
+//
+
+static boolean RB_OcclusionActive(void)
+{
+    return (rbOcclusionCulling && has_GL_ARB_occlusion_query && occlusionssects &&
+            !occlusionsuspended);
+}
+
+//
+// RB_BeginOcclusionFrame
+//
+// Collects the results of the queries issued last frame. A result
+// that isn't back yet counts as visible rather than stalling for it.
+//
+
+void RB_BeginOcclusionFrame(void)
+{
+    int i;
+
+    occlusionframe++;
+    walkdrawn = 0;
+    walkculled = 0;
+
+    if(!occlusionssects || !has_GL_ARB_occlusion_query)
+    {
+        numqueryboxes = 0;
+        return;
+    }
+
+    for(i = 0; i < numqueryboxes; ++i)
+    {
+        occlusionbox_t *occ = queryboxes[i];
+        GLuint available = 0;
+        GLuint samples = 1;
+
+        dglGetQueryObjectuivARB(queryids[i], GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+
+        if(available)
+        {
+            dglGetQueryObjectuivARB(queryids[i], GL_QUERY_RESULT_ARB, &samples);
+        }
+
+        if(samples)
+        {
+            occ->hidden = 0;
+        }
+        else if(occ->hidden < 255)
+        {
+            occ->hidden++;
+        }
+
+        occ->resultframe = occlusionframe;
+    }
+
+    numqueryboxes = 0;
+}
+
+//
+// RB_IsBoxNearView
+//
+
+static boolean RB_IsBoxNearView(const fixed_t *bbox)
+{
+    const fixed_t margin = OCCLUSION_REVEALMARGIN + OCCLUSION_NEARMARGIN;
+
+    return (viewx > bbox[BOXLEFT] - margin && viewx < bbox[BOXRIGHT] + margin &&
+            viewy > bbox[BOXBOTTOM] - margin && viewy < bbox[BOXTOP] + margin);
+}
+
+//
+// RB_QueueOcclusionBox
+//
+
+static void RB_QueueOcclusionBox(occlusionbox_t *occ)
+{
+    occ->queryframe = occlusionframe;
+    queryboxes[numqueryboxes++] = occ;
+}
+
+//
+// RB_GetNodeHeights
+//
+// Lowest floor and highest ceiling under a node, gathered at most
+// once a frame since sectors move
+//
+
+static void RB_GetNodeHeights(int bspnum, fixed_t *floorz, fixed_t *ceilingz)
+{
+    occlusionbox_t *occ;
+    fixed_t floorz2, ceilingz2;
+
+    if(bspnum & NF_SUBSECTOR)
+    {
+        sector_t *sector;
+
+        if(bspnum == -1)
+        {
+            bspnum = 0;
+        }
+
+        sector = subsectors[bspnum & ~NF_SUBSECTOR].sector;
+        *floorz = sector->floorheight;
+        *ceilingz = sector->ceilingheight;
+        return;
+    }
+
+    occ = &occlusionnodes[bspnum];
+
+    if(occ->heightframe != occlusionframe)
+    {
+        RB_GetNodeHeights(nodes[bspnum].children[0], &occ->floorz, &occ->ceilingz);
+        RB_GetNodeHeights(nodes[bspnum].children[1], &floorz2, &ceilingz2);
+
+        occ->floorz = MIN(occ->floorz, floorz2);
+        occ->ceilingz = MAX(occ->ceilingz, ceilingz2);
+        occ->heightframe = occlusionframe;
+    }
+
+    *floorz = occ->floorz;
+    *ceilingz = occ->ceilingz;
+}
+
+//
+// RB_CheckSubsectorOcclusion
+//
+// Returns true if the subsector's walls and flats should be left out
+// this frame, and queues it for a query when it's due for one
+//
+
+boolean RB_CheckSubsectorOcclusion(int num)
+{
+    occlusionbox_t *occ;
+    sector_t *sector;
+
+    if(!RB_OcclusionActive())
+    {
+        return false;
+    }
+
+    occ = &occlusionssects[num];
+    sector = subsectors[num].sector;
+
+    if(occ->queryframe == occlusionframe)
+    {
+        // already dealt with this frame
+        return (occ->hidden >= OCCLUSION_HIDDENFRAMES && occ->resultframe == occlusionframe);
+    }
+
+    // too close to test, or out of view where a hidden result would
+    // only mean it was off screen
+    if(RB_IsBoxNearView(occ->bbox) ||
+        !RB_CheckBoxInView(&rbPlayerView, occ->bbox, sector->floorheight, sector->ceilingheight))
+    {
+        occ->hidden = 0;
+        walkdrawn++;
+        return false;
+    }
+
+    occ->floorz = sector->floorheight;
+    occ->ceilingz = sector->ceilingheight;
+
+    // only trust a hidden streak if its last result came in this frame
+    if(occ->hidden >= OCCLUSION_HIDDENFRAMES && occ->resultframe == occlusionframe)
+    {
+        RB_QueueOcclusionBox(occ);
+        occlusionstats.culled++;
+        walkculled++;
+        return true;
+    }
+
+    if(occ->hidden || ((num + occlusionframe) & OCCLUSION_RETESTMASK) == 0)
+    {
+        RB_QueueOcclusionBox(occ);
+    }
+
+    walkdrawn++;
+    return false;
+}
+
+//
+// RB_CheckNodeOcclusion
+//
+// Returns true if the node's whole subtree should be skipped this
+// frame, in which case its box is queued for a query in its place
+//
+
+boolean RB_CheckNodeOcclusion(int num)
+{
+    occlusionbox_t *occ;
+
+    if(!RB_OcclusionActive())
+    {
+        return false;
+    }
+
+    occ = &occlusionnodes[num];
+
+    if(!occ->hidden || occ->resultframe != occlusionframe)
+    {
+        return false;
+    }
+
+    RB_GetNodeHeights(num, &occ->floorz, &occ->ceilingz);
+
+    if(RB_IsBoxNearView(occ->bbox) ||
+        !RB_CheckBoxInView(&rbPlayerView, occ->bbox, occ->floorz, occ->ceilingz))
+    {
+        occ->hidden = 0;
+        return false;
+    }
+
+    RB_QueueOcclusionBox(occ);
+    occlusionstats.nodes++;
+    walkculled++;
+    return true;
+}
+
+//
+// RB_BeginNodeWalk
+//
+
+void RB_BeginNodeWalk(occlusionwalk_t *walk)
+{
+    walk->drawn = walkdrawn;
+    walk->culled = walkculled;
+}
+
+//
+// RB_EndNodeWalk
+//
+// A node where everything the walk reached was culled has its own box
+// queued, so the subtree can be skipped from next frame if that comes
+// back hidden too
+//
+
+void RB_EndNodeWalk(int num, const occlusionwalk_t *walk)
+{
+    occlusionbox_t *occ;
+
+    if(!RB_OcclusionActive())
+    {
+        return;
+    }
+
+    occ = &occlusionnodes[num];
+
+    if(walkdrawn != walk->drawn || walkculled == walk->culled)
+    {
+        occ->hidden = 0;
+        return;
+    }
+
+    RB_GetNodeHeights(num, &occ->floorz, &occ->ceilingz);
+
+    if(!RB_IsBoxNearView(occ->bbox) &&
+        RB_CheckBoxInView(&rbPlayerView, occ->bbox, occ->floorz, occ->ceilingz))
+    {
+        RB_QueueOcclusionBox(occ);
+    }
+}
+
+//
+// RB_DrawOcclusionQueries
+//
+// Draws the queued bounding boxes, grown by OCCLUSION_REVEALMARGIN,
+// against the depth buffer with color and depth writes off. Must run
+// after the opaque walls and flats are drawn and before anything
+// translucent.
+//
+
+void RB_DrawOcclusionQueries(void)
+{
+    const float margin = FIXED2FLOAT(OCCLUSION_REVEALMARGIN);
+    int i;
+
+    if(numqueryboxes <= 0 || occlusionsuspended)
+    {
+        return;
+    }
+
+    if(numqueryboxes > numqueryids)
+    {
+        queryids = Z_Realloc(queryids, numqueryboxes * sizeof(GLuint), PU_STATIC, NULL);
+        dglGenQueriesARB(numqueryboxes - numqueryids, &queryids[numqueryids]);
+        numqueryids = numqueryboxes;
+    }
+
+    RB_BindTexture(&whiteTexture);
+    RB_SetState(GLSTATE_CULL, false);
+    RB_SetState(GLSTATE_ALPHATEST, false);
+    RB_SetColorMask(0);
+    RB_SetDepthMask(0);
+
+    for(i = 0; i < numqueryboxes; ++i)
+    {
+        occlusionbox_t *occ = queryboxes[i];
+        float x1 = FIXED2FLOAT(occ->bbox[BOXLEFT]) - margin;
+        float x2 = FIXED2FLOAT(occ->bbox[BOXRIGHT]) + margin;
+        float y1 = FIXED2FLOAT(occ->bbox[BOXBOTTOM]) - margin;
+        float y2 = FIXED2FLOAT(occ->bbox[BOXTOP]) + margin;
+        float z1 = FIXED2FLOAT(occ->floorz) - margin;
+        float z2 = FIXED2FLOAT(occ->ceilingz) + margin;
+
+        dglBeginQueryARB(GL_SAMPLES_PASSED_ARB, queryids[i]);
+
+        dglBegin(GL_QUADS);
+        // bottom and top
+        dglVertex3f(x1, y1, z1); dglVertex3f(x2, y1, z1); dglVertex3f(x2, y2, z1); dglVertex3f(x1, y2, z1);
+        dglVertex3f(x1, y1, z2); dglVertex3f(x2, y1, z2); dglVertex3f(x2, y2, z2); dglVertex3f(x1, y2, z2);
+        // sides
+        dglVertex3f(x1, y1, z1); dglVertex3f(x2, y1, z1); dglVertex3f(x2, y1, z2); dglVertex3f(x1, y1, z2);
+        dglVertex3f(x1, y2, z1); dglVertex3f(x2, y2, z1); dglVertex3f(x2, y2, z2); dglVertex3f(x1, y2, z2);
+        dglVertex3f(x1, y1, z1); dglVertex3f(x1, y2, z1); dglVertex3f(x1, y2, z2); dglVertex3f(x1, y1, z2);
+        dglVertex3f(x2, y1, z1); dglVertex3f(x2, y2, z1); dglVertex3f(x2, y2, z2); dglVertex3f(x2, y1, z2);
+        dglEnd();
+
+        dglEndQueryARB(GL_SAMPLES_PASSED_ARB);
+    }
+
+    occlusionstats.queries += numqueryboxes;
+
+    RB_SetDepthMask(1);
+    RB_SetColorMask(1);
+    RB_SetState(GLSTATE_ALPHATEST, true);
+    RB_SetState(GLSTATE_CULL, true);
+}
+
+//
+// RB_SuspendOcclusion
+//
+// The streaks only make sense for the one view they were measured
+// from. Extra views rendered in the same frame suspend culling so
+// they neither use nor disturb them, and the queries queued for the
+// primary view aren't drawn against another view's depth buffer.
+//
+
+void RB_SuspendOcclusion(boolean suspend)
+{
+    occlusionsuspended = suspend;
+}
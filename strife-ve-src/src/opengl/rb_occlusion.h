@@ -0,0 +1,45 @@
+//
+// Copyright(C) 2014 Night Dive Studios, Inc.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+
+#ifndef __RB_OCCLUSION_H__
+#define __RB_OCCLUSION_H__
+
+#include "doomtype.h"
+
+typedef struct
+{
+    int         queries;        // occlusion queries issued this frame
+    int         culled;         // subsectors whose walls and flats were skipped
+    int         nodes;          // BSP subtrees skipped by the walk
+} occlusionstats_t;
+
+extern occlusionstats_t occlusionstats;
+
+// walk counts saved on entering a node, see RB_BeginNodeWalk
+typedef struct
+{
+    int         drawn;
+    int         culled;
+} occlusionwalk_t;
+
+void RB_InitOcclusion(void);
+void RB_BeginOcclusionFrame(void);
+boolean RB_CheckSubsectorOcclusion(int num);
+boolean RB_CheckNodeOcclusion(int num);
+void RB_BeginNodeWalk(occlusionwalk_t *walk);
+void RB_EndNodeWalk(int num, const occlusionwalk_t *walk);
+void RB_DrawOcclusionQueries(void);
+void RB_SuspendOcclusion(boolean suspend);
+
+#endif
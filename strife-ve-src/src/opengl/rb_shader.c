@@ -16,13 +16,67 @@
 //    Shader Program (GLSL)
 //
 
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #include "rb_main.h"
 #include "rb_gl.h"
 #include "rb_shader.h"
 #include "deh_str.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_misc.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
+#ifndef GL_OBJECT_ACTIVE_UNIFORMS_ARB
+#define GL_OBJECT_ACTIVE_UNIFORMS_ARB   0x8B86
+#endif
+
+shaderstats_t shaderstats;
+
+// [SVE]: programs loaded from -shaderdir, polled for edits
+#define MAX_RELOAD_PROGRAMS     16
+#define RELOAD_POLL_MS          500
+
+typedef struct
+{
+    rbShader_t  *shader;
+    char        name[9];
+    time_t      mtime[RST_TOTAL];
+} rbReloadProgram_t;
+
+static char *shaderdir;
+static rbReloadProgram_t reloadPrograms[MAX_RELOAD_PROGRAMS];
+static int numReloadPrograms;
+static int lastReloadCheck;
+
+//
+// SP_Init
+//
+
+void SP_Init(void)
+{
+    int p;
+
+    //!
+    // @arg <directory>
+    // @category video
+    //
+    // Load GLSL programs from NAME_V.glsl and NAME_F.glsl in the given
+    // directory where present rather than the IWAD, and rebuild them
+    // whenever either file changes.
+    //
+
+    p = M_CheckParmWithArgs("-shaderdir", 1);
+
+    if(p)
+    {
+        shaderdir = myargv[p + 1];
+    }
+}
+
 //
 // SP_Enable
 //
@@ -41,6 +95,7 @@ void SP_Enable(rbShader_t *shader)
     
     dglUseProgramObjectARB(shader->programObj);
     rbState.currentProgram = shader->programObj;
+    shaderstats.switches++;
 }
 
 //
@@ -63,6 +118,84 @@ void SP_Delete(rbShader_t *shader)
     dglDeleteObjectARB(shader->vertexProgram);
     dglDeleteObjectARB(shader->programObj);
     shader->bLoaded = false;
+    shader->numUniforms = 0;
+}
+
+//
+// SP_GetUniform
+//
+// Names the program doesn't use are remembered too, with location -1.
+// Returns NULL once the table is full, or for names too long to store,
+// which the caller then looks up uncached.
+//
+
+static rbUniform_t *SP_GetUniform(rbShader_t *shader, const char *name)
+{
+    rbUniform_t *u;
+    int i;
+
+    for(i = 0; i < shader->numUniforms; ++i)
+    {
+        if(!strcmp(shader->uniforms[i].name, name))
+        {
+            return &shader->uniforms[i];
+        }
+    }
+
+    // a cut off copy would never match again and fill up the table
+    if(shader->numUniforms == MAX_SHADER_UNIFORMS || strlen(name) >= MAX_UNIFORM_NAME)
+    {
+        return NULL;
+    }
+
+    u = &shader->uniforms[shader->numUniforms++];
+    M_StringCopy(u->name, name, MAX_UNIFORM_NAME);
+    u->location = dglGetUniformLocationARB(shader->programObj, name);
+    u->bSet = false;
+
+    return u;
+}
+
+//
+// SP_UniformChanged
+//
+// Sets loc to the uniform's location and returns true if it needs
+// uploading. Pass val as NULL for values that aren't worth comparing.
+//
+
+static boolean SP_UniformChanged(rbShader_t *shader, const char *name,
+                                 const float *val, const int count, int *loc)
+{
+    rbUniform_t *u = SP_GetUniform(shader, name);
+
+    if(u == NULL)
+    {
+        *loc = dglGetUniformLocationARB(shader->programObj, name);
+    }
+    else
+    {
+        *loc = u->location;
+
+        if(*loc != -1 && val != NULL)
+        {
+            if(u->bSet && !memcmp(u->value, val, count * sizeof(float)))
+            {
+                shaderstats.skipped++;
+                return false;
+            }
+
+            memcpy(u->value, val, count * sizeof(float));
+            u->bSet = true;
+        }
+    }
+
+    if(*loc == -1)
+    {
+        return false;
+    }
+
+    shaderstats.uploads++;
+    return true;
 }
 
 //
@@ -72,15 +205,14 @@ void SP_Delete(rbShader_t *shader)
 void SP_SetUniform1i(rbShader_t *shader, const char *name, const int val)
 {
     int loc;
+    float f = (float)val;
     
     if(!has_GL_ARB_shader_objects)
     {
         return;
     }
 
-    loc = dglGetUniformLocationARB(shader->programObj, name);
-
-    if(loc != -1)
+    if(SP_UniformChanged(shader, name, &f, 1, &loc))
     {
         dglUniform1iARB(loc, val);
     }
@@ -99,9 +231,7 @@ void SP_SetUniform1f(rbShader_t *shader, const char *name, const float val)
         return;
     }
 
-    loc = dglGetUniformLocationARB(shader->programObj, name);
-
-    if(loc != -1)
+    if(SP_UniformChanged(shader, name, &val, 1, &loc))
     {
         dglUniform1fARB(loc, val);
     }
@@ -120,31 +250,41 @@ void SP_SetUniformMat4(rbShader_t *shader, const char *name, matrix val, boolean
         return;
     }
     
-    loc = dglGetUniformLocationARB(shader->programObj, name);
-
-    if(loc != -1)
+    if(SP_UniformChanged(shader, name, bTranspose ? NULL : val, 16, &loc))
     {
         dglUniformMatrix4fvARB(loc, 1, bTranspose, val);
     }
 }
 
 //
-// SP_Compile
+// SP_SetUniform4fv
+//
+// Arrays are always sent
 //
 
-static void SP_Compile(rbShader_t *shader, const char *name, rShaderType_t type)
+void SP_SetUniform4fv(rbShader_t *shader, const char *name, const int count, const float *val)
 {
-    byte *data;
-    int length;
-    int lump;
-    rhandle *handle;
+    int loc;
 
-    lump = W_GetNumForName((char*)name);
-    length = W_LumpLength(lump);
+    if(!has_GL_ARB_shader_objects)
+    {
+        return;
+    }
+
+    if(SP_UniformChanged(shader, name, NULL, 0, &loc))
+    {
+        dglUniform4fvARB(loc, count, val);
+    }
+}
+
+//
+// SP_CompileSource
+//
+
+static void SP_CompileSource(rbShader_t *shader, const char *source, rShaderType_t type)
+{
+    rhandle *handle;
 
-    data = (byte*)Z_Calloc(length+1, sizeof(char), PU_STATIC, NULL);
-    W_ReadLump(lump, data);
-    
     if(type == RST_VERTEX)
     {
         shader->vertexProgram = dglCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
@@ -157,13 +297,31 @@ static void SP_Compile(rbShader_t *shader, const char *name, rShaderType_t type)
     }
     else
     {
-        Z_Free(data);
         return;
     }
     
-    dglShaderSourceARB(*handle, 1, (const GLcharARB**)&data, NULL);
+    dglShaderSourceARB(*handle, 1, (const GLcharARB**)&source, NULL);
     dglCompileShaderARB(*handle);
     dglAttachObjectARB(shader->programObj, *handle);
+}
+
+//
+// SP_Compile
+//
+
+static void SP_Compile(rbShader_t *shader, const char *name, rShaderType_t type)
+{
+    byte *data;
+    int length;
+    int lump;
+
+    lump = W_GetNumForName((char*)name);
+    length = W_LumpLength(lump);
+
+    data = (byte*)Z_Calloc(length+1, sizeof(char), PU_STATIC, NULL);
+    W_ReadLump(lump, data);
+
+    SP_CompileSource(shader, (const char*)data, type);
     
     Z_Free(data);
 }
@@ -192,6 +350,53 @@ static void SP_DumpErrorLog(const rhandle handle)
     }
 }
 
+//
+// SP_CacheUniforms
+//
+// Fills the uniform table with everything the linked program uses
+//
+
+static void SP_CacheUniforms(rbShader_t *shader)
+{
+    int count;
+    int i;
+
+    shader->numUniforms = 0;
+    dglGetObjectParameterivARB(shader->programObj, GL_OBJECT_ACTIVE_UNIFORMS_ARB, &count);
+
+    for(i = 0; i < count && shader->numUniforms < MAX_SHADER_UNIFORMS; ++i)
+    {
+        char name[MAX_UNIFORM_NAME];
+        char *bracket;
+        int length;
+        int size;
+        GLenum type;
+
+        dglGetActiveUniformARB(shader->programObj, i, MAX_UNIFORM_NAME, &length,
+                               &size, &type, name);
+
+        // may have been cut off, leave it to be looked up uncached
+        if(length >= MAX_UNIFORM_NAME - 1)
+        {
+            continue;
+        }
+
+        // built-in state isn't set through here
+        if(!strncmp(name, "gl_", 3))
+        {
+            continue;
+        }
+
+        // some drivers report arrays as name[0]
+        if((bracket = strchr(name, '[')) != NULL)
+        {
+            *bracket = '\0';
+        }
+
+        SP_GetUniform(shader, name);
+    }
+}
+
 //
 // SP_Link
 //
@@ -201,6 +406,7 @@ static boolean SP_Link(rbShader_t *shader)
     int linked;
     
     shader->bHasErrors = false;
+    shader->numUniforms = 0;
     dglLinkProgramARB(shader->programObj);
     dglGetObjectParameterivARB(shader->programObj, GL_OBJECT_LINK_STATUS_ARB, &linked);
     
@@ -211,12 +417,89 @@ static boolean SP_Link(rbShader_t *shader)
         SP_DumpErrorLog(shader->vertexProgram);
         SP_DumpErrorLog(shader->fragmentProgram);
     }
+    else
+    {
+        SP_CacheUniforms(shader);
+    }
     
     dglUseProgramObjectARB(0);
+    rbState.currentProgram = 0;
     shader->bLoaded = true;
     return (linked > 0);
 }
 
+//
+// SP_FileTime
+//
+
+static time_t SP_FileTime(const char *path)
+{
+    struct stat st;
+
+    if(stat(path, &st) != 0)
+    {
+        return 0;
+    }
+
+    return st.st_mtime;
+}
+
+//
+// SP_ProgramPath
+//
+
+static void SP_ProgramPath(char *path, size_t size, const char *program, rShaderType_t type)
+{
+    M_snprintf(path, size, "%s%c%s_%c.glsl", shaderdir, DIR_SEPARATOR,
+               program, type == RST_VERTEX ? 'V' : 'F');
+}
+
+//
+// SP_LoadProgramFiles
+//
+// Builds the program from -shaderdir if both its files can be read,
+// replacing whatever was built before
+//
+
+static boolean SP_LoadProgramFiles(rbShader_t *shader, const char *program, time_t *mtime)
+{
+    char path[RST_TOTAL][512];
+    char *source[RST_TOTAL];
+    int i;
+
+    for(i = 0; i < RST_TOTAL; ++i)
+    {
+        SP_ProgramPath(path[i], sizeof(path[i]), program, i);
+
+        if(!M_FileExists(path[i]))
+        {
+            return false;
+        }
+    }
+
+    for(i = 0; i < RST_TOTAL; ++i)
+    {
+        mtime[i] = SP_FileTime(path[i]);
+        M_ReadFileAsString(path[i], &source[i]);
+    }
+
+    if(source[RST_VERTEX] != NULL && source[RST_FRAGMENT] != NULL)
+    {
+        SP_Delete(shader);
+        SP_LoadProgramText(shader, source[RST_VERTEX], source[RST_FRAGMENT]);
+    }
+
+    for(i = 0; i < RST_TOTAL; ++i)
+    {
+        if(source[i] != NULL)
+        {
+            Z_Free(source[i]);
+        }
+    }
+
+    return (source[RST_VERTEX] != NULL && source[RST_FRAGMENT] != NULL);
+}
+
 //
 // SP_LoadProgram
 //
@@ -232,6 +515,19 @@ void SP_LoadProgram(rbShader_t *shader, const char *program)
     {
         return;
     }
+
+    if(shaderdir != NULL && numReloadPrograms < MAX_RELOAD_PROGRAMS)
+    {
+        rbReloadProgram_t *rp = &reloadPrograms[numReloadPrograms];
+
+        if(SP_LoadProgramFiles(shader, program, rp->mtime))
+        {
+            rp->shader = shader;
+            M_StringCopy(rp->name, program, sizeof(rp->name));
+            numReloadPrograms++;
+            return;
+        }
+    }
     
     shader->programObj = dglCreateProgramObjectARB();
 
@@ -243,3 +539,88 @@ void SP_LoadProgram(rbShader_t *shader, const char *program)
 
     SP_Link(shader);
 }
+
+//
+// SP_LoadProgramText
+//
+// [SVE]: for programs built into the executable rather than the IWAD
+//
+
+void SP_LoadProgramText(rbShader_t *shader, const char *vertex, const char *fragment)
+{
+    shader->bHasErrors = false;
+    shader->bLoaded = false;
+
+    if(!has_GL_ARB_shader_objects)
+    {
+        return;
+    }
+
+    shader->programObj = dglCreateProgramObjectARB();
+
+    SP_CompileSource(shader, vertex, RST_VERTEX);
+    SP_CompileSource(shader, fragment, RST_FRAGMENT);
+
+    SP_Link(shader);
+}
+
+//
+// SP_CheckReload
+//
+// Call once a frame. Rebuilds -shaderdir programs whose files have
+// changed; a program that fails to build keeps reporting bHasErrors
+// until it is fixed.
+//
+
+void SP_CheckReload(void)
+{
+    int now;
+    int i;
+    int j;
+
+    if(numReloadPrograms == 0)
+    {
+        return;
+    }
+
+    now = I_GetTimeMS();
+
+    if(now - lastReloadCheck < RELOAD_POLL_MS)
+    {
+        return;
+    }
+
+    lastReloadCheck = now;
+
+    for(i = 0; i < numReloadPrograms; ++i)
+    {
+        rbReloadProgram_t *rp = &reloadPrograms[i];
+        char path[512];
+
+        for(j = 0; j < RST_TOTAL; ++j)
+        {
+            SP_ProgramPath(path, sizeof(path), rp->name, j);
+
+            if(SP_FileTime(path) != rp->mtime[j])
+            {
+                break;
+            }
+        }
+
+        if(j == RST_TOTAL)
+        {
+            continue;
+        }
+
+        if(rbState.currentProgram == rp->shader->programObj)
+        {
+            RB_DisableShaders();
+        }
+
+        if(SP_LoadProgramFiles(rp->shader, rp->name, rp->mtime))
+        {
+            fprintf(stderr, "SP_CheckReload: rebuilt %s%s\n", rp->name,
+                    rp->shader->bHasErrors ? " (with errors)" : "");
+        }
+    }
+}
@@ -25,6 +25,20 @@ typedef enum
     RST_TOTAL
 } rShaderType_t;
 
+// [SVE]: uniform locations are looked up once when the program links and
+// the last value sent is kept, so setting an unchanged uniform costs no
+// GL call
+#define MAX_SHADER_UNIFORMS     24
+#define MAX_UNIFORM_NAME        32
+
+typedef struct
+{
+    char        name[MAX_UNIFORM_NAME];
+    int         location;
+    boolean     bSet;
+    float       value[16];
+} rbUniform_t;
+
 typedef struct
 {
     rhandle     programObj;
@@ -32,13 +46,28 @@ typedef struct
     rhandle     fragmentProgram;
     boolean     bHasErrors;
     boolean     bLoaded;
+    rbUniform_t uniforms[MAX_SHADER_UNIFORMS];
+    int         numUniforms;
 } rbShader_t;
 
+typedef struct
+{
+    int         switches;       // program binds this frame
+    int         uploads;        // uniform values sent this frame
+    int         skipped;        // uniform sets that matched the last value
+} shaderstats_t;
+
+extern shaderstats_t shaderstats;
+
+void SP_Init(void);
 void SP_Enable(rbShader_t *shader);
 void SP_Delete(rbShader_t *shader);
 void SP_SetUniform1i(rbShader_t *shader, const char *name, const int val);
 void SP_SetUniform1f(rbShader_t *shader, const char *name, const float val);
 void SP_SetUniformMat4(rbShader_t *shader, const char *name, matrix val, boolean bTranspose);
+void SP_SetUniform4fv(rbShader_t *shader, const char *name, const int count, const float *val);
 void SP_LoadProgram(rbShader_t *shader, const char *program);
+void SP_LoadProgramText(rbShader_t *shader, const char *vertex, const char *fragment);
+void SP_CheckReload(void);
 
 #endif
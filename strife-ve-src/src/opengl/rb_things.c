@@ -236,7 +236,7 @@ void RB_SetupSprites(void)
                           (vis->y - rbPlayerView.y) * rbPlayerView.rotyaw.s) / 2;
 
         // don't draw the player that we're viewing
-        if(vis->spr->type == MT_PLAYER && vis->spr->player == &players[displayplayer])
+        if(vis->spr->type == MT_PLAYER && vis->spr->player == rbViewPlayer)
         {
             continue;
         }
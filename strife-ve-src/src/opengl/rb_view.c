@@ -27,6 +27,7 @@
 #include "rb_things.h"
 #include "rb_draw.h"
 #include "rb_dynlights.h"
+#include "rb_occlusion.h"
 #include "p_local.h"
 #include "i_video.h"
 #include "r_main.h"
@@ -35,10 +36,17 @@
 #include "doomstat.h"
 
 rbView_t rbPlayerView;
+player_t *rbViewPlayer;
 
 #define Z_NEAR          0.1f
 #define FIXED_ASPECT    1.2f
 
+// [SVE]: other players' views composited over the primary one
+#define MAX_EXTRA_VIEWS 3
+
+static rbfbo_t extraViewFBO[MAX_EXTRA_VIEWS];
+static int numExtraViews;
+
 //
 // RB_SetupMatrices
 //
@@ -363,14 +371,65 @@ void RB_ProjectPointToView(rbView_t *view, fixed_t fx, fixed_t fy, fixed_t fz, f
 }
 
 //
-// RB_RenderPlayerView
+// RB_DrawInsetSprites
+//
+// Like FBO_Draw for the sprite framebuffer, but only takes the corner
+// an inset sized view was rendered into
 //
 
-void RB_RenderPlayerView(player_t *player)
+static void RB_DrawInsetSprites(rbfbo_t *inset)
+{
+    vtx_t v[4];
+    float tu = (float)inset->fboWidth / (float)spriteFBO.fboWidth;
+    float tv = (float)inset->fboHeight / (float)spriteFBO.fboHeight;
+
+    RB_SetVertexColor(v, 0xff, 0xff, 0xff, 0xff, 4);
+    v[0].z = v[1].z = v[2].z = v[3].z = 0;
+
+    v[0].x = v[2].x = 0;
+    v[0].y = v[1].y = 0;
+    v[1].x = v[3].x = SCREENWIDTH;
+    v[2].y = v[3].y = SCREENHEIGHT;
+
+    v[0].tu = v[2].tu = 0;
+    v[0].tv = v[1].tv = tv;
+    v[1].tu = v[3].tu = tu;
+    v[2].tv = v[3].tv = 0;
+
+    RB_SetState(GLSTATE_CULL, true);
+    RB_SetCull(GLCULL_FRONT);
+    RB_SetState(GLSTATE_DEPTHTEST, false);
+    RB_SetState(GLSTATE_BLEND, true);
+    RB_SetState(GLSTATE_ALPHATEST, true);
+
+    FBO_BindImage(&spriteFBO);
+    RB_DrawVtxQuadImmediate(v);
+    FBO_UnBindImage(&spriteFBO);
+
+    RB_SetState(GLSTATE_DEPTHTEST, true);
+}
+
+//
+// RB_RenderViewScene
+//
+// Renders the world as seen by the given player into the current
+// framebuffer. Shared by the primary view and any extra player views.
+// An inset view is rendered into the lower left corner at the size of
+// its framebuffer.
+//
+
+static void RB_RenderViewScene(player_t *player, rbfbo_t *inset)
 {
+    rbViewPlayer = player;
+
     // setup view and sprite list
     RB_SetupView(player, &rbPlayerView, rbFOV);
     RB_ClearSprites();
+
+    if(inset)
+    {
+        dglViewport(0, 0, inset->fboWidth, inset->fboHeight);
+    }
     
     if(rbDynamicLights)
     {
@@ -399,9 +458,149 @@ void RB_RenderPlayerView(player_t *player)
     if(rbFixSpriteClipping)
     {
         RB_SetBlend(GLSRC_ONE, GLDST_ONE_MINUS_SRC_ALPHA);
-        FBO_Draw(&spriteFBO, false);
+
+        if(inset)
+        {
+            RB_DrawInsetSprites(inset);
+        }
+        else
+        {
+            FBO_Draw(&spriteFBO, false);
+        }
+    }
+}
+
+//
+// RB_RenderExtraViews
+//
+// [SVE]: with gl_player_views set, the views of up to that many
+// other players are drawn first, each at quarter size and copied into
+// its own framebuffer before the primary view clears the back buffer.
+// They skip the weapon sprites, post-processing and HUD, and don't take
+// part in occlusion culling. Only cooperative games and demo playback
+// get them, since in deathmatch they would show the opponents' views.
+//
+
+static void RB_RenderExtraViews(void)
+{
+    int views = MIN(rbPlayerViews, MAX_EXTRA_VIEWS);
+    int i;
+
+    numExtraViews = 0;
+
+    if(views <= 0 || !(demoplayback || (netgame && !deathmatch)))
+    {
+        return;
+    }
+
+    RB_SuspendOcclusion(true);
+
+    for(i = 0; i < MAXPLAYERS && numExtraViews < views; ++i)
+    {
+        rbfbo_t *fbo = &extraViewFBO[numExtraViews];
+
+        if(i == displayplayer || !playeringame[i] || !players[i].mo)
+        {
+            continue;
+        }
+
+        if(!fbo->bLoaded ||
+           fbo->fboWidth != screen_width / 4 || fbo->fboHeight != screen_height / 4)
+        {
+            FBO_Delete(fbo);
+            FBO_InitColorAttachment(fbo, 0, screen_width / 4, screen_height / 4);
+        }
+
+        RB_RenderViewScene(&players[i], fbo);
+        RB_ResetViewPort();
+
+        FBO_CopyBackBuffer(fbo, 0, 0, fbo->fboWidth, fbo->fboHeight);
+        numExtraViews++;
+    }
+
+    RB_SuspendOcclusion(false);
+}
+
+//
+// RB_DrawExtraViews
+//
+// Composites the extra player views down the right edge of the screen
+//
+
+static void RB_DrawExtraViews(void)
+{
+    vtx_t v[4];
+    int i;
+
+    if(numExtraViews <= 0)
+    {
+        return;
+    }
+
+    RB_SetOrtho();
+
+    RB_SetState(GLSTATE_CULL, true);
+    RB_SetCull(GLCULL_FRONT);
+    RB_SetState(GLSTATE_DEPTHTEST, false);
+    RB_SetState(GLSTATE_BLEND, false);
+    RB_SetState(GLSTATE_ALPHATEST, false);
+
+    RB_SetVertexColor(v, 0xff, 0xff, 0xff, 0xff, 4);
+    v[0].z = v[1].z = v[2].z = v[3].z = 0;
+
+    v[0].tu = v[2].tu = 0;
+    v[0].tv = v[1].tv = 1;
+    v[1].tu = v[3].tu = 1;
+    v[2].tv = v[3].tv = 0;
+
+    for(i = 0; i < numExtraViews; ++i)
+    {
+        float x = SCREENWIDTH - (SCREENWIDTH / 4) - 4;
+        float y = 4 + i * ((SCREENHEIGHT / 4) + 4);
+
+        v[0].x = v[2].x = x;
+        v[0].y = v[1].y = y;
+        v[1].x = v[3].x = x + (SCREENWIDTH / 4);
+        v[2].y = v[3].y = y + (SCREENHEIGHT / 4);
+
+        FBO_BindImage(&extraViewFBO[i]);
+        RB_DrawVtxQuadImmediate(v);
+        FBO_UnBindImage(&extraViewFBO[i]);
     }
 
+    RB_SetState(GLSTATE_ALPHATEST, true);
+    RB_SetState(GLSTATE_BLEND, true);
+    RB_SetState(GLSTATE_DEPTHTEST, true);
+}
+
+//
+// RB_ShutdownViews
+//
+
+void RB_ShutdownViews(void)
+{
+    int i;
+
+    for(i = 0; i < MAX_EXTRA_VIEWS; ++i)
+    {
+        FBO_Delete(&extraViewFBO[i]);
+    }
+}
+
+//
+// RB_RenderPlayerView
+//
+
+void RB_RenderPlayerView(player_t *player)
+{
+    // render the other players' views ahead of our own
+    RB_RenderExtraViews();
+
+    // pick up last frame's occlusion results
+    RB_BeginOcclusionFrame();
+
+    RB_RenderViewScene(player, NULL);
+
     // render player weapons
     RB_RenderPlayerSprites(player);
 
@@ -416,6 +615,9 @@ void RB_RenderPlayerView(player_t *player)
     // render player flash
     RB_DrawPlayerFlash(player);
 
+    // composite the other players' views
+    RB_DrawExtraViews();
+
     // render additional hud set pieces independent from the patch buffer
     RB_DrawExtraHudPics();
 
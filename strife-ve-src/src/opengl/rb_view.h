@@ -53,6 +53,7 @@ typedef struct
 } rbView_t;
 
 extern rbView_t rbPlayerView;
+extern player_t *rbViewPlayer;
 
 void RB_SetupFrameForView(rbView_t *view, const float fov);
 boolean RB_CheckPointsInView(rbView_t *view, vtx_t *vertex, int count);
@@ -60,5 +61,6 @@ boolean RB_CheckSphereInView(rbView_t *view, const float x, const float y, const
 boolean RB_CheckBoxInView(rbView_t *view, fixed_t *box, const fixed_t z1, const fixed_t z2);
 void RB_ProjectPointToView(rbView_t *view, fixed_t fx, fixed_t fy, fixed_t fz, float *out_x, float *out_y);
 void RB_RenderPlayerView(player_t *player);
+void RB_ShutdownViews(void);
 
 #endif
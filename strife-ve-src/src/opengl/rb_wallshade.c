@@ -28,6 +28,13 @@
 static rbShadeDef_t *shadedefs;
 static int numshadedefs;
 
+// [SVE]: the RGB of every shade def at every sector light level, so
+// shading a wall, flat or thing is a table read rather than an HSV
+// conversion. rebuilt for a def only when its color changes
+static byte (*shadelightrgb)[256][3];
+
+shadestats_t shadestats;
+
 //
 // dfcmp
 //
@@ -214,6 +221,59 @@ static void RB_GetRGB(int h, int s, int v, int *r, int *g, int *b)
     *b = (int)(xb * 255.0f);
 }
 
+//
+// RB_ShadeValueForLight
+//
+
+static int RB_ShadeValueForLight(rbShadeDef_t *shadedef, int light)
+{
+    return MIN((int)((float)shadedef->v * ((float)(light << 2) / 1024)), 255);
+}
+
+//
+// RB_BuildShadeLightTable
+//
+
+static void RB_BuildShadeLightTable(rbShadeDef_t *shadedef)
+{
+    byte (*table)[3] = shadelightrgb[shadedef->self];
+    int light;
+
+    for(light = 0; light < 256; ++light)
+    {
+        int r, g, b;
+
+        RB_GetRGB(shadedef->h, shadedef->s, RB_ShadeValueForLight(shadedef, light), &r, &g, &b);
+
+        table[light][0] = (byte)r;
+        table[light][1] = (byte)g;
+        table[light][2] = (byte)b;
+    }
+}
+
+//
+// RB_GetShadeRGB
+// Color of a shade def at the given light level
+//
+
+static void RB_GetShadeRGB(rbShadeDef_t *shadedef, int light, int *r, int *g, int *b)
+{
+    if(light >= 0 && light < 256)
+    {
+        const byte *rgb = shadelightrgb[shadedef->self][light];
+
+        *r = rgb[0];
+        *g = rgb[1];
+        *b = rgb[2];
+
+        shadestats.lookups++;
+        return;
+    }
+
+    RB_GetRGB(shadedef->h, shadedef->s, RB_ShadeValueForLight(shadedef, light), r, g, b);
+    shadestats.computed++;
+}
+
 //
 // RB_InitWallShades
 //
@@ -345,6 +405,13 @@ void RB_InitWallShades(void)
             ++shade;
         }
 
+        shadelightrgb = Z_Malloc(numshadedefs * sizeof(*shadelightrgb), PU_STATIC, 0);
+
+        for(i = 0; i < numshadedefs; ++i)
+        {
+            RB_BuildShadeLightTable(&shadedefs[i]);
+        }
+
         // initialize hash table
         shade = shadedefs;
         for(i = 0; i < numshadedefs; ++i)
@@ -401,11 +468,17 @@ void RB_SetSkyShade(byte r, byte g, byte b)
 
     if((rsd = RB_FindShadeDef(R_FlatNumForName("F_SKY001"))))
     {
+        if(rsd->r == r && rsd->g == g && rsd->b == b)
+        {
+            return;
+        }
+
         rsd->r = r;
         rsd->g = g;
         rsd->b = b;
 
         RB_GetHSV(r, g, b, &rsd->h, &rsd->s, &rsd->v);
+        RB_BuildShadeLightTable(rsd);
     }
 }
 
@@ -549,14 +622,13 @@ static void RB_SetupWallShadeColor(seg_t *seg, rbShadeDef_t *shadedef, int *r, i
     else
     {
         // need to adjust value for sector's brightness level
-        int seglight, v;
+        int seglight;
         if(shadedef->flags & RBSF_SEGLIGHTING)
             seglight = *l; // preserve fake contrast already set on the seg
         else
             seglight = seg->frontsector->lightlevel; // go back to sector lighting
 
-        v = MIN((int)((float)shadedef->v * ((float)(seglight << 2) / 1024)), 255);
-        RB_GetRGB(shadedef->h, shadedef->s, v, r, g, b);
+        RB_GetShadeRGB(shadedef, seglight, r, g, b);
     }
 }
 
@@ -644,7 +716,6 @@ boolean RB_SetWallShade(vtx_t *vtx, int lightlevel, seg_t *seg, rbWallSide_t sid
 
 boolean RB_GetFloorShade(sector_t *sector, byte *r, byte *g, byte *b)
 {
-    int v;
     int tr, tg, tb;
     rbShadeDef_t *shadedef = sector->floorshade;
 
@@ -658,8 +729,7 @@ boolean RB_GetFloorShade(sector_t *sector, byte *r, byte *g, byte *b)
         return false;
     }
     
-    v = MIN((int)((float)shadedef->v * ((float)(sector->lightlevel << 2) / 1024)), 255);
-    RB_GetRGB(shadedef->h, shadedef->s, v, &tr, &tg, &tb);
+    RB_GetShadeRGB(shadedef, sector->lightlevel, &tr, &tg, &tb);
 
     *r = (byte)tr;
     *g = (byte)tg;
@@ -674,7 +744,6 @@ boolean RB_GetFloorShade(sector_t *sector, byte *r, byte *g, byte *b)
 
 boolean RB_GetCeilingShade(sector_t *sector, byte *r, byte *g, byte *b)
 {
-    int v;
     int tr, tg, tb;
     rbShadeDef_t *shadedef = sector->ceilingshade;
 
@@ -683,8 +752,7 @@ boolean RB_GetCeilingShade(sector_t *sector, byte *r, byte *g, byte *b)
         return false;
     }
     
-    v = MIN((int)((float)shadedef->v * ((float)(sector->lightlevel << 2) / 1024)), 255);
-    RB_GetRGB(shadedef->h, shadedef->s, v, &tr, &tg, &tb);
+    RB_GetShadeRGB(shadedef, sector->lightlevel, &tr, &tg, &tb);
 
     *r = (byte)tr;
     *g = (byte)tg;
@@ -711,9 +779,7 @@ static void RB_SetupThingShadeColor(sector_t *sec, rbShadeDef_t *shadedef,
     else
     {
         // need to adjust value for sector's brightness level
-        int v = MIN((int)((float)shadedef->v * ((float)(sec->lightlevel << 2) / 1024)), 255);
-
-        RB_GetRGB(shadedef->h, shadedef->s, v, r, g, b);
+        RB_GetShadeRGB(shadedef, sec->lightlevel, r, g, b);
     }
 }
 
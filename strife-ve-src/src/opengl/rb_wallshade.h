@@ -21,6 +21,14 @@
 #include "r_defs.h"
 #include "d_player.h"
 
+typedef struct
+{
+    int         lookups;        // shade colors read from the light tables
+    int         computed;       // shade colors converted from HSV
+} shadestats_t;
+
+extern shadestats_t shadestats;
+
 void RB_InitWallShades(void);
 void RB_SetSectorShades(sector_t *sec);
 void RB_SetSkyShade(byte r, byte g, byte b);
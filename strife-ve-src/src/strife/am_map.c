@@ -25,6 +25,7 @@
 #include "z_zone.h"
 #include "doomkeys.h"
 #include "doomdef.h"
+#include "m_bbox.h"
 #include "m_misc.h"
 #include "st_stuff.h"
 #include "p_local.h"
@@ -223,6 +224,20 @@ fixed_t         m_x2, m_y2;     // UR x,y where the window is on the map (map co
 fixed_t         m_w;
 fixed_t         m_h;
 
+//
+// [SVE]: Lines around the automap window, gathered from the blockmap.
+// The list is kept across frames and only rebuilt once the window pans
+// or zooms out of the block range it was gathered for, or shrinks well
+// inside it. Colours are still worked out per frame, since mapping and
+// moving sectors change them.
+//
+static int*     amlines;
+static int      numamlines;
+static int      maxamlines;
+static int      amlinerange[4];     // block range the list covers
+static line_t*  amlinelevel;        // lines[] it was built against
+static int      amlinecount;
+
 // based on level size
 static fixed_t  min_x;
 static fixed_t  min_y; 
@@ -559,6 +574,9 @@ void AM_LevelInit(void)
 
     AM_clearMarks();
 
+    // [SVE]: line indices from the last level are no good here
+    amlinelevel = NULL;
+
     AM_findMinMaxBoundaries();
     scale_mtof = FixedDiv(min_scale_mtof, (int) (0.7*FRACUNIT));
     if (scale_mtof > max_scale_mtof)
@@ -1214,6 +1232,113 @@ AM_drawMline
 
 }*/
 
+//
+// AM_viewBox
+// Map area the automap shows. The GL automap works it out from its
+// frustum, which sees further than the window on wide screens.
+//
+static void AM_viewBox(fixed_t *box)
+{
+    if(use3drenderer && RB_GetAutomapExtents(box))
+        return;
+
+    box[BOXLEFT]   = m_x;
+    box[BOXRIGHT]  = m_x2;
+    box[BOXBOTTOM] = m_y;
+    box[BOXTOP]    = m_y2;
+}
+
+//
+// AM_blockRange
+// Block range covering the box grown by a fraction of its size on
+// every side, clamped to the blockmap. A negative growshift doesn't
+// grow it at all.
+//
+static void AM_blockRange(int *range, const fixed_t *box, int growshift)
+{
+    int64_t gx = 0;
+    int64_t gy = 0;
+
+    if(growshift >= 0)
+    {
+        gx = ((int64_t)box[BOXRIGHT] - box[BOXLEFT]) >> growshift;
+        gy = ((int64_t)box[BOXTOP] - box[BOXBOTTOM]) >> growshift;
+    }
+
+    range[BOXLEFT]   = (int)(((int64_t)box[BOXLEFT] - gx - bmaporgx) >> MAPBLOCKSHIFT);
+    range[BOXRIGHT]  = (int)(((int64_t)box[BOXRIGHT] + gx - bmaporgx) >> MAPBLOCKSHIFT);
+    range[BOXBOTTOM] = (int)(((int64_t)box[BOXBOTTOM] - gy - bmaporgy) >> MAPBLOCKSHIFT);
+    range[BOXTOP]    = (int)(((int64_t)box[BOXTOP] + gy - bmaporgy) >> MAPBLOCKSHIFT);
+
+    range[BOXLEFT]   = MAX(range[BOXLEFT], 0);
+    range[BOXBOTTOM] = MAX(range[BOXBOTTOM], 0);
+    range[BOXRIGHT]  = MIN(range[BOXRIGHT], bmapwidth - 1);
+    range[BOXTOP]    = MIN(range[BOXTOP], bmapheight - 1);
+}
+
+//
+// AM_gatherLines
+//
+static void AM_gatherLines(void)
+{
+    fixed_t view[4];
+    int     need[4];
+    int     x;
+    int     y;
+    short*  list;
+    line_t* ld;
+
+    AM_viewBox(view);
+    AM_blockRange(need, view, -1);
+
+    if(amlinelevel == lines && amlinecount == numlines
+        && need[BOXLEFT]   >= amlinerange[BOXLEFT]
+        && need[BOXRIGHT]  <= amlinerange[BOXRIGHT]
+        && need[BOXBOTTOM] >= amlinerange[BOXBOTTOM]
+        && need[BOXTOP]    <= amlinerange[BOXTOP]
+        && (amlinerange[BOXRIGHT] - amlinerange[BOXLEFT] + 1) <=
+           (need[BOXRIGHT] - need[BOXLEFT] + 1) * 3)
+    {
+        return;
+    }
+
+    // rebuild with half a view of slack, so following the player
+    //  or panning doesn't rebuild every frame
+    AM_blockRange(amlinerange, view, 1);
+    amlinelevel = lines;
+    amlinecount = numlines;
+    numamlines = 0;
+
+    validcount++;
+
+    for(y = amlinerange[BOXBOTTOM]; y <= amlinerange[BOXTOP]; y++)
+    {
+        for(x = amlinerange[BOXLEFT]; x <= amlinerange[BOXRIGHT]; x++)
+        {
+            list = blockmaplump + blockmap[y * bmapwidth + x];
+
+            for( ; *list != -1; list++)
+            {
+                ld = &lines[*list];
+
+                if(ld->validcount == validcount)
+                    continue;
+
+                ld->validcount = validcount;
+
+                if(numamlines == maxamlines)
+                {
+                    maxamlines = maxamlines ? maxamlines * 2 : 256;
+                    amlines = Z_Realloc(amlines, maxamlines * sizeof(*amlines),
+                                        PU_STATIC, NULL);
+                }
+
+                amlines[numamlines++] = *list;
+            }
+        }
+    }
+}
+
 //
 // Determines visible lines, draws them.
 // This is LineDef based, not LineSeg based.
@@ -1224,9 +1349,11 @@ void AM_drawWalls(void)
     line_t* line;
     static mline_t l;
 
-    for(i = 0; i < numlines; i++)
+    AM_gatherLines();
+
+    for(i = 0; i < numamlines; i++)
     {
-        line = &lines[i];
+        line = &lines[amlines[i]];
 
         l.a.x = line->v1->x;
         l.a.y = line->v1->y;
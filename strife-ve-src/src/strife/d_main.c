@@ -59,6 +59,7 @@
 #include "p_saveg.h"
 #include "p_dialog.h" // haleyjd [STRIFE]
 
+#include "i_capture.h"
 #include "i_endoom.h"
 #include "i_joystick.h"
 #include "i_system.h"
@@ -1383,6 +1384,9 @@ static void D_InitFrontend()
         DEH_printf("S_Init: Setting up sound.\n");
     S_Init (sfxVolume * 8, musicVolume * 8, voiceVolume * 8); // [STRIFE]: voice
 
+    // [SVE]: -capture taps the mixer, so start it once sound is up
+    I_InitCapture();
+
     // haleyjd 20110210: Create Strife hub save folders
     M_CreateSaveDirs(savegamedir);
 
@@ -100,6 +100,11 @@ static fehelpstr_t helpStrs[] =
         "gfx_more",
         "View and change more options for the high quality renderer."
     },
+    {
+        "gl_bloom_quality",
+        "Choose how bloom is blurred. \"Classic\" blurs at full resolution, "
+        "the other settings blur at reduced sizes and are much faster."
+    },
     {
         "gl_bloom_threshold",
         "Determines strength of the bloom effect. A lower threshold creates "
@@ -160,7 +165,7 @@ static fehelpstr_t helpStrs[] =
     },
     {
         "gl_max_decals",
-        "Set the maximum number of decals. Range is from 16 to 128."
+        "Set the maximum number of decals. Range is from 16 to 4096."
     },
     {
         "gl_fov",
@@ -528,7 +533,7 @@ static void FE_SetMusicVolume(int volume)
 static fevar_t feVariables[] =
 {
     { "gl_bloom_threshold",        FE_VAR_FLOAT,   0,    0, 0, 0.4f, 1.0f, 0.06f   },
-    { "gl_max_decals",             FE_VAR_INT,     16, 128, 8                      },
+    { "gl_max_decals",             FE_VAR_INT_PO2, 4,   12, 1                      },
     { "gl_fov",                    FE_VAR_FLOAT,   0,    0, 0, 74.0f, 110.0f, 1.5f },
     { "gl_motion_blur_ramp_speed", FE_VAR_FLOAT,   0,    0, 0, 0.0f, 1.0f, 0.0625f },
     { "gl_motion_blur_samples",    FE_VAR_INT_PO2, 3,    6, 1                      },
@@ -920,6 +925,14 @@ static const char *dynLightTypes[] =
     "Fast"
 };
 
+static const char *bloomQualityNames[] =
+{
+    "Classic",
+    "Low",
+    "Medium",
+    "High"
+};
+
 enum
 {
     FE_MUSIC_ACTION,
@@ -1030,6 +1043,13 @@ static fevaluerange_t values[] =
         FE_NUMMUSIC-1,
         feMusicNames
     },
+    {
+        true,
+        "gl_bloom_quality",
+        0,
+        3,
+        bloomQualityNames
+    },
     {
         true,
         "gl_dynamic_light_fast_blend",
@@ -556,6 +556,7 @@ static femenuitem_t optionsGraphicsLightItems[] =
 {
     { FE_MITEM_TOGGLE, "Bloom",              "gl_enable_bloom"    },
     { FE_MITEM_SLIDER, "Bloom Threshold",    "gl_bloom_threshold" },
+    { FE_MITEM_VALUES, "Bloom Quality",      "gl_bloom_quality"   },
     { FE_MITEM_TOGGLE, "Dynamic Lights",     "gl_dynamic_lights"  },
     { FE_MITEM_VALUES, "Dynamic Light Type", "gl_dynamic_light_fast_blend" },
     { FE_MITEM_TOGGLE, "Lightmaps",          "gl_lightmaps",      FE_FONT_SMALL, FE_TOGGLE_DEFAULT },
@@ -36,6 +36,7 @@
 
 // [SVE] svillarreal
 #include "rb_decal.h"
+#include "rb_dynlights.h"
 
 extern line_t *spechit[];  // haleyjd:
 extern int     numspechit; // [STRIFE] - needed in P_XYMovement
@@ -82,6 +83,8 @@ P_SetMobjState
 	
 	state = st->nextstate;
     } while (!mobj->tics);
+
+    RB_UpdateLightEmitter(mobj); // [SVE]
 				
     return true;
 }
@@ -798,6 +801,7 @@ P_SpawnMobj
 
     P_MobjBackupPosition(mobj); // [SVE] interpolation
     P_AddThinker (&mobj->thinker);
+    RB_UpdateLightEmitter(mobj); // [SVE]
 
     return mobj;
 }
@@ -855,6 +859,7 @@ void P_RemoveMobj (mobj_t* mobj)
 
     // free block
     P_RemoveThinker ((thinker_t*)mobj);
+    RB_UpdateLightEmitter(mobj); // [SVE]
 }
 
 
@@ -286,6 +286,10 @@ typedef struct mobj_s
     // haleyjd 20140902: [SVE] interpolation data
     prevpos_t           prevpos;
 
+    // [SVE]: one past this thing's place in the renderer's light emitter
+    // list, or 0 if its state doesn't give off light
+    int                 lightslot;
+
     // Interaction info, by BLOCKMAP.
     // Links in blocks (if needed).
     struct mobj_s*      bnext;
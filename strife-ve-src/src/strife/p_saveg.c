@@ -34,6 +34,9 @@
 #include "doomstat.h"
 #include "r_state.h"
 
+// [SVE]
+#include "rb_dynlights.h"
+
 #define SAVEGAME_EOF 0x1d
 
 // haleyjd 09/28/10: [STRIFE] VERSIONSIZE == 8
@@ -2066,6 +2069,8 @@ void P_UnArchiveThinkers (void)
             //mobj->ceilingz = mobj->subsector->sector->ceilingheight;
             mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
             P_AddThinker (&mobj->thinker);
+            mobj->lightslot = 0;            // [SVE]
+            RB_UpdateLightEmitter(mobj);
             break;
 
         default:
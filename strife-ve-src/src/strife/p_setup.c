@@ -31,6 +31,8 @@
 #include "rb_level.h"
 #include "rb_data.h"
 #include "rb_dynlights.h"
+#include "rb_lightgrid.h"
+#include "rb_occlusion.h"
 
 #include "z_zone.h"
 #include "deh_main.h"
@@ -496,7 +498,6 @@ void P_LoadSectors (int lump)
         ss->thinglist = NULL;
         ss->floorshade   = NULL; // haleyjd [SVE]
         ss->ceilingshade = NULL;
-        ss->decallist = NULL; // [SVE] svillarreal
         ss->altlightlevel = -1; // [SVE] svillarreal
         ss->validclip[0] = -1;
         ss->validclip[1] = -1;
@@ -1099,6 +1100,8 @@ static void P_LoadLightGrid(const int lump)
         }
     }
 
+    RB_InitLightGrid(); // [SVE]
+
     W_ReleaseLumpNum(lump);
 }
 
@@ -1390,6 +1393,7 @@ void P_SetupLevel(int map, int playermask, skill_t skill)
 
     // [SVE] svillarreal
     RB_ClearDecalLinks();
+    RB_ClearLightEmitters();
 
     // [STRIFE] Removed ExMy map support
     if(map < 10)
@@ -1457,6 +1461,9 @@ void P_SetupLevel(int map, int playermask, skill_t skill)
         P_LoadSegs(lumpnum+ML_SEGS);
     }
 
+    // [SVE]: everything after this may look up subsectors
+    R_InitPointGrid();
+
     // haleyjd 20140904: [SVE] create sector interpolation data
     P_CreateSectorInterps();
 
@@ -1504,6 +1511,7 @@ void P_SetupLevel(int map, int playermask, skill_t skill)
     {
         RB_PrecacheLevel();
         RB_InitLightMarks();
+        RB_InitOcclusion();
         DL_Init();
     }
 
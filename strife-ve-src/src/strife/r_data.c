@@ -19,10 +19,13 @@
 
 #include <stdio.h>
 
+#include "SDL.h"
+
 #include "d_main.h"
 #include "deh_main.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "z_zone.h"
 #include "w_wad.h"
 #include "doomdef.h"
@@ -115,6 +118,9 @@ fixed_t*	spritetopoffset;
 // [SVE] svillarreal
 fixed_t*    spriteheight;
 
+// [SVE]: level precache composite statistics for -printglstats
+compositestats_t compositestats;
+
 lighttable_t	*colormaps;
 
 
@@ -173,14 +179,14 @@ R_DrawColumnInCache
 
 
 //
-// R_GenerateComposite
-// Using the texture definition,
-//  the composite texture is created from the patches,
-//  and each column is cached.
+// R_CompositeColumns
+// Draws the multi-patch columns of a texture into its
+//  composite block. realpatches[] holds the cached lump for
+//  each of texture->patches. Touches no zone memory, so the
+//  level precache can run it from worker threads.
 //
-void R_GenerateComposite (int texnum)
+static void R_CompositeColumns (int texnum, byte *block, patch_t **realpatches)
 {
-    byte*		block;
     texture_t*		texture;
     texpatch_t*		patch;	
     patch_t*		realpatch;
@@ -194,21 +200,15 @@ void R_GenerateComposite (int texnum)
 	
     texture = textures[texnum];
 
-    block = Z_Malloc (texturecompositesize[texnum],
-		      PU_STATIC, 
-		      &texturecomposite[texnum]);	
-
     collump = texturecolumnlump[texnum];
     colofs = texturecolumnofs[texnum];
     
     // Composite the columns together.
-    patch = texture->patches;
-		
     for (i=0 , patch = texture->patches;
 	 i<texture->patchcount;
 	 i++, patch++)
     {
-	realpatch = W_CacheLumpNum (patch->patch, PU_CACHE);
+	realpatch = realpatches[i];
 	x1 = patch->originx;
 	x2 = x1 + SHORT(realpatch->width);
 
@@ -235,6 +235,47 @@ void R_GenerateComposite (int texnum)
 	}
 						
     }
+}
+
+
+
+//
+// R_GenerateComposite
+// Using the texture definition,
+//  the composite texture is created from the patches,
+//  and each column is cached.
+//
+void R_GenerateComposite (int texnum)
+{
+    byte*		block;
+    texture_t*		texture;
+    patch_t**		realpatches;
+    int			i;
+	
+    texture = textures[texnum];
+
+    block = Z_Malloc (texturecompositesize[texnum],
+		      PU_STATIC, 
+		      &texturecomposite[texnum]);	
+
+    // [SVE]: hold the patches static while compositing; caching
+    //  a later one may otherwise purge an earlier one
+    realpatches = Z_Malloc (texture->patchcount * sizeof(*realpatches),
+			    PU_STATIC, NULL);
+
+    for (i=0 ; i<texture->patchcount ; i++)
+	realpatches[i] = W_CacheLumpNum (texture->patches[i].patch, PU_STATIC);
+
+    R_CompositeColumns (texnum, block, realpatches);
+
+    for (i=0 ; i<texture->patchcount ; i++)
+	W_ReleaseLumpNum (texture->patches[i].patch);
+
+    Z_Free (realpatches);
+
+    // Not precached with the level (or purged since); count it so
+    //  -printglstats shows mid-game compositing.
+    compositestats.lazybuilds++;
 
     // Now that the texture has been built in column cache,
     //  it is purgable from zone memory.
@@ -860,6 +901,158 @@ void R_SoundNumForDoor(vldoor_t* door)
 
 
 
+//
+// [SVE]: level composite precache.
+// Every multi-patch texture the level can show is composited
+//  up front into a PU_LEVEL block, so it stays resident (and is
+//  never purged back to a mid-game R_GenerateComposite) until
+//  P_SetupLevel frees the level tags. Zone allocation and lump
+//  caching stay on the main thread; the column copies are then
+//  shared out over worker threads, which only read patches that
+//  R_PrecacheLevel holds PU_STATIC.
+//
+
+#define MAXCOMPOSITETHREADS 8
+
+typedef struct
+{
+    int		texnum;
+    byte*	block;
+    patch_t**	realpatches;
+} compositejob_t;
+
+static compositejob_t*	compositejobs;
+static int		numcompositejobs;
+static SDL_atomic_t	nextcompositejob;
+
+static int R_CompositeWorker (void *unused)
+{
+    int		job;
+
+    while ((job = SDL_AtomicAdd(&nextcompositejob, 1)) < numcompositejobs)
+    {
+	R_CompositeColumns(compositejobs[job].texnum,
+			   compositejobs[job].block,
+			   compositejobs[job].realpatches);
+    }
+
+    return 0;
+}
+
+static void R_PrecacheComposites (char *texturepresent)
+{
+    SDL_Thread*	threads[MAXCOMPOSITETHREADS];
+    patch_t**	patchbase;
+    patch_t**	realpatches;
+    texture_t*	texture;
+    uint64_t	starttime;
+    int		numpatches;
+    int		numthreads;
+    int		i;
+    int		j;
+
+    starttime = I_GetTimeUS();
+
+    compositestats.textures = 0;
+    compositestats.bytes = 0;
+    compositestats.lazybuilds = 0;
+
+    numcompositejobs = 0;
+    numpatches = 0;
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (texturepresent[i] && texturecompositesize[i] > 0)
+	{
+	    numcompositejobs++;
+	    numpatches += textures[i]->patchcount;
+	}
+    }
+
+    if (!numcompositejobs)
+    {
+	compositestats.threads = 0;
+	compositestats.build_us = 0;
+	return;
+    }
+
+    compositejobs = Z_Malloc(numcompositejobs * sizeof(*compositejobs),
+			     PU_STATIC, NULL);
+    patchbase = Z_Malloc(numpatches * sizeof(*patchbase), PU_STATIC, NULL);
+    realpatches = patchbase;
+
+    numcompositejobs = 0;
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (!texturepresent[i] || texturecompositesize[i] <= 0)
+	    continue;
+
+	compositestats.textures++;
+	compositestats.bytes += texturecompositesize[i];
+
+	// Already resident from a lazy build on an earlier level;
+	//  just pin it for this one.
+	if (texturecomposite[i])
+	{
+	    Z_ChangeTag(texturecomposite[i], PU_LEVEL);
+	    continue;
+	}
+
+	texture = textures[i];
+
+	// the patches are already held PU_STATIC by the caller,
+	//  so this only resolves pointers
+	for (j=0 ; j<texture->patchcount ; j++)
+	    realpatches[j] = W_CacheLumpNum(texture->patches[j].patch, PU_STATIC);
+
+	compositejobs[numcompositejobs].texnum = i;
+	compositejobs[numcompositejobs].block =
+	    Z_Malloc(texturecompositesize[i], PU_LEVEL, (void **)&texturecomposite[i]);
+	compositejobs[numcompositejobs].realpatches = realpatches;
+	numcompositejobs++;
+
+	realpatches += texture->patchcount;
+    }
+
+    numthreads = SDL_GetCPUCount() - 1;
+
+    if (numthreads > MAXCOMPOSITETHREADS)
+	numthreads = MAXCOMPOSITETHREADS;
+
+    // not worth a thread for a handful of textures
+    if (numthreads > numcompositejobs / 16)
+	numthreads = numcompositejobs / 16;
+
+    SDL_AtomicSet(&nextcompositejob, 0);
+
+    for (i=0 ; i<numthreads ; i++)
+    {
+	threads[i] = SDL_CreateThread(R_CompositeWorker, "R_Composite", NULL);
+
+	if (!threads[i])
+	    break;
+    }
+
+    numthreads = i;
+
+    // the main thread takes jobs as well, and finishes any
+    //  a failed thread creation left behind
+    R_CompositeWorker(NULL);
+
+    for (i=0 ; i<numthreads ; i++)
+	SDL_WaitThread(threads[i], NULL);
+
+    compositestats.threads = numthreads + 1;
+    compositestats.build_us = (int)(I_GetTimeUS() - starttime);
+
+    Z_Free(patchbase);
+    Z_Free(compositejobs);
+    compositejobs = NULL;
+}
+
+
+
 //
 // R_PrecacheLevel
 // Preloads all relevant graphics for the level.
@@ -882,6 +1075,7 @@ void R_PrecacheLevel (void)
     texture_t*		texture;
     thinker_t*		th;
     spriteframe_t*	sf;
+    anim_t*		anim;
 
     if (demoplayback)
 	return;
@@ -928,6 +1122,32 @@ void R_PrecacheLevel (void)
     //  a wall texture, with an episode dependend
     //  name.
     texturepresent[skytexture] = 1;
+
+    // [SVE]: pull in whole animation chains and the other half of
+    //  every switch pair, so neither composites in the middle of play
+    for (anim = anims ; anim < lastanim ; anim++)
+    {
+	if (!anim->istexture)
+	    continue;
+
+	for (i=anim->basepic ; i<anim->basepic+anim->numpics ; i++)
+	{
+	    if (texturepresent[i])
+		break;
+	}
+
+	if (i == anim->basepic+anim->numpics)
+	    continue;
+
+	for (i=anim->basepic ; i<anim->basepic+anim->numpics ; i++)
+	    texturepresent[i] = 1;
+    }
+
+    for (i=0 ; i<numswitches*2 ; i++)
+    {
+	if (texturepresent[switchlist[i]])
+	    texturepresent[switchlist[i^1]] = 1;
+    }
 	
     texturememory = 0;
     for (i=0 ; i<numtextures ; i++)
@@ -941,10 +1161,23 @@ void R_PrecacheLevel (void)
 	{
 	    lump = texture->patches[j].patch;
 	    texturememory += lumpinfo[lump].size;
-	    W_CacheLumpNum(lump , PU_CACHE);
+	    W_CacheLumpNum(lump , PU_STATIC);
 	}
     }
 
+    R_PrecacheComposites(texturepresent);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (!texturepresent[i])
+	    continue;
+
+	texture = textures[i];
+
+	for (j=0 ; j<texture->patchcount ; j++)
+	    W_ReleaseLumpNum(texture->patches[j].patch);
+    }
+
     Z_Free(texturepresent);
     
     // Precache sprites.
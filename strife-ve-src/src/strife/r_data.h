@@ -86,6 +86,18 @@ R_GetColumn
 void R_InitData (void);
 void R_PrecacheLevel (void);
 
+// [SVE]: composite texture precache statistics, for -printglstats
+typedef struct
+{
+    int textures;       // composites resident for the level
+    int bytes;          // their total size
+    int threads;        // threads used to build them
+    int build_us;       // time spent building them at level load
+    int lazybuilds;     // composites built mid-level since
+} compositestats_t;
+
+extern compositestats_t compositestats;
+
 
 // Retrieval.
 // Floor/ceiling opaque texture tiles,
@@ -197,9 +197,6 @@ typedef struct sector_s
     // [SVE] svillarreal - minimum bloom threshold
     short bloomthreshold;
 
-    // [SVE] svillarreal - decal links
-    struct rbDecal_s *decallist;
-
 } sector_t;
 
 
@@ -341,6 +338,7 @@ typedef struct subsector_s
     word            numleafs;
     word            leaf;
     lightMapInfo_t  lightMapInfo[2];
+    struct rbDecal_s *decallist;
 } subsector_t;
 
 
@@ -459,10 +457,6 @@ typedef struct drawseg_s
 // I.e. a sprite object that is partly visible.
 typedef struct vissprite_s
 {
-    // Doubly linked list.
-    struct vissprite_s* prev;
-    struct vissprite_s* next;
-    
     int         x1;
     int         x2;
 
@@ -36,6 +36,13 @@
 // State.
 #include "doomstat.h"
 
+// [SVE]: span texel addresses are worked out four at a time where SSE2
+// is available; the texel fetches themselves stay scalar
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPAN_SSE2
+#endif
+
 
 // ?
 #define MAXWIDTH			1120
@@ -64,6 +71,24 @@ int		viewwindowy;
 byte*		ylookup[MAXHEIGHT]; 
 int		columnofs[MAXWIDTH]; 
 
+// [SVE] Distance in bytes between vertically adjacent pixels for the
+// column drawers, and between horizontally adjacent ones for the span
+// drawers. These are SCREENWIDTH and 1 when drawing straight into
+// I_VideoBuffer, and get swapped around for the column-major buffer.
+int		dc_pitch = SCREENWIDTH;
+int		ds_pitch = 1;
+
+// [SVE] Optional column-major view buffer. Each column of the view is
+// contiguous, so the column drawers walk memory linearly instead of
+// touching a new line every pixel. R_TransposeViewBuffer copies it
+// into I_VideoBuffer once the view is finished.
+boolean		r_columnmajor;
+static byte	columnbuffer[SCREENWIDTH*SCREENHEIGHT];
+
+// tile size for the transpose, small enough that both the source
+// columns and destination rows of a tile stay in L1
+#define TRANSPOSE_BLOCK 16
+
 // Color tables for different players,
 //  translate a limited part to another
 //  (color ramps used for  suit colors).
@@ -108,6 +133,7 @@ void R_DrawColumn (void)
 { 
     int			count; 
     byte*		dest; 
+    int			pitch = dc_pitch;
     fixed_t		frac;
     fixed_t		fracstep;	 
  
@@ -143,7 +169,7 @@ void R_DrawColumn (void)
 	//  using a lighting/special effects LUT.
 	*dest = dc_colormap[dc_source[(frac>>FRACBITS)&127]];
 	
-	dest += SCREENWIDTH; 
+	dest += pitch;
 	frac += fracstep;
 	
     } while (count--); 
@@ -227,6 +253,7 @@ void R_DrawMVisTLColumn(void)
 {
     int                 count; 
     byte*               dest; 
+    int                 pitch = dc_pitch;
     fixed_t             frac;
     fixed_t             fracstep;
 
@@ -264,7 +291,7 @@ void R_DrawMVisTLColumn(void)
         byte src = dc_colormap[dc_source[(frac>>FRACBITS)&127]];
         byte col = xlatab[*dest + (src << 8)];
         *dest = col;
-        dest += SCREENWIDTH;
+        dest += pitch;
         frac += fracstep;
     } while(count--);
 }
@@ -280,6 +307,7 @@ void R_DrawTLColumn(void)
 {
     int                 count; 
     byte*               dest; 
+    int                 pitch = dc_pitch;
     fixed_t             frac;
     fixed_t             fracstep;	 
 
@@ -317,7 +345,7 @@ void R_DrawTLColumn(void)
         byte src = dc_colormap[dc_source[(frac>>FRACBITS)&127]];
         byte col = xlatab[(*dest << 8) + src];
         *dest = col;
-        dest += SCREENWIDTH;
+        dest += pitch;
         frac += fracstep;
     } while(count--);
 }
@@ -340,6 +368,7 @@ void R_DrawTranslatedColumn (void)
 { 
     int                 count; 
     byte*               dest; 
+    int                 pitch = dc_pitch;
     fixed_t             frac;
     fixed_t             fracstep;
 
@@ -373,7 +402,7 @@ void R_DrawTranslatedColumn (void)
         // Thus the "green" ramp of the player 0 sprite
         //  is mapped to gray, red, black/indigo. 
         *dest = dc_colormap[dc_translation[dc_source[frac>>FRACBITS]]];
-        dest += SCREENWIDTH;
+        dest += pitch;
         frac += fracstep; 
     } while (count--); 
 } 
@@ -390,6 +419,7 @@ void R_DrawTRTLColumn(void)
 {
     int                 count; 
     byte*               dest; 
+    int                 pitch = dc_pitch;
     fixed_t             frac;
     fixed_t             fracstep;
 
@@ -419,7 +449,7 @@ void R_DrawTRTLColumn(void)
         byte src = dc_colormap[dc_translation[dc_source[frac>>FRACBITS&127]]];
         byte col = xlatab[(*dest << 8) + src];
         *dest = col;
-        dest += SCREENWIDTH;
+        dest += pitch;
         frac += fracstep; 
     } while (count--); 
 }
@@ -590,6 +620,7 @@ void R_DrawSpan (void)
 { 
     unsigned int position, step;
     byte *dest;
+    int pitch = ds_pitch;
     int count;
     int spot;
     unsigned int xtemp, ytemp;
@@ -619,9 +650,38 @@ void R_DrawSpan (void)
     dest = ylookup[ds_y] + columnofs[ds_x1];
 
     // We do not check for zero spans here?
-    count = ds_x2 - ds_x1;
+    count = ds_x2 - ds_x1 + 1;
 
-    do
+#ifdef SPAN_SSE2
+    if (count >= 4)
+    {
+        const __m128i ymask = _mm_set1_epi32(0x0fc0);
+        __m128i pos4 = _mm_setr_epi32(position, position + step,
+                                      position + step * 2,
+                                      position + step * 3);
+        __m128i step4 = _mm_set1_epi32(step * 4);
+        int spots[4];
+
+        do
+        {
+            _mm_storeu_si128((__m128i *) spots,
+                             _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pos4, 4), ymask),
+                                          _mm_srli_epi32(pos4, 26)));
+
+            dest[0]         = ds_colormap[ds_source[spots[0]]];
+            dest[pitch]     = ds_colormap[ds_source[spots[1]]];
+            dest[pitch * 2] = ds_colormap[ds_source[spots[2]]];
+            dest[pitch * 3] = ds_colormap[ds_source[spots[3]]];
+            dest += pitch * 4;
+
+            pos4 = _mm_add_epi32(pos4, step4);
+            position += step * 4;
+            count -= 4;
+        } while (count >= 4);
+    }
+#endif
+
+    while (count-- > 0)
     {
 	// Calculate current texture index in u,v.
         ytemp = (position >> 4) & 0x0fc0;
@@ -630,11 +690,11 @@ void R_DrawSpan (void)
 
 	// Lookup pixel from flat texture tile,
 	//  re-index using light/colormap.
-	*dest++ = ds_colormap[ds_source[spot]];
+	*dest = ds_colormap[ds_source[spot]];
+	dest += pitch;
 
         position += step;
-
-    } while (count--);
+    }
 }
 
 
@@ -720,6 +780,7 @@ void R_DrawSpanLow (void)
     unsigned int position, step;
     unsigned int xtemp, ytemp;
     byte *dest;
+    int pitch = ds_pitch;
     int count;
     int spot;
 
@@ -757,8 +818,10 @@ void R_DrawSpanLow (void)
 
 	// Lowres/blocky mode does it twice,
 	//  while scale is adjusted appropriately.
-	*dest++ = ds_colormap[ds_source[spot]];
-	*dest++ = ds_colormap[ds_source[spot]];
+	*dest = ds_colormap[ds_source[spot]];
+	dest += pitch;
+	*dest = ds_colormap[ds_source[spot]];
+	dest += pitch;
 
 	position += step;
 
@@ -794,10 +857,69 @@ R_InitBuffer
     else 
 	viewwindowy = (SCREENHEIGHT-SBARHEIGHT-height) >> 1; 
 
+    // [SVE] column-major: the view gets its own buffer with one
+    // height-long run per column
+    if (r_columnmajor)
+    {
+        for (i=0 ; i<width ; i++)
+            columnofs[i] = i*height;
+        for (i=0 ; i<height ; i++)
+            ylookup[i] = columnbuffer + i;
+
+        dc_pitch = 1;
+        ds_pitch = height;
+        return;
+    }
+
     // Preclaculate all row offsets.
 	for (i=0 ; i<height ; i++)
 		ylookup[i] = I_VideoBuffer + (i+viewwindowy)*SCREENWIDTH;
+
+    dc_pitch = SCREENWIDTH;
+    ds_pitch = 1;
 } 
+
+
+//
+// R_TransposeViewBuffer
+//
+// [SVE] Copies the column-major view into its window in I_VideoBuffer,
+// a tile at a time. Does nothing when drawing directly to the screen.
+//
+void R_TransposeViewBuffer (void)
+{
+    int		bx, by;
+    int		x, y;
+    int		xend, yend;
+    byte*	src;
+    byte*	dest;
+
+    if (!r_columnmajor)
+        return;
+
+    for (by=0 ; by<viewheight ; by+=TRANSPOSE_BLOCK)
+    {
+        yend = MIN(by+TRANSPOSE_BLOCK, viewheight);
+
+        for (bx=0 ; bx<scaledviewwidth ; bx+=TRANSPOSE_BLOCK)
+        {
+            xend = MIN(bx+TRANSPOSE_BLOCK, scaledviewwidth);
+
+            for (y=by ; y<yend ; y++)
+            {
+                src = columnbuffer + bx*viewheight + y;
+                dest = I_VideoBuffer + (y+viewwindowy)*SCREENWIDTH
+                     + viewwindowx + bx;
+
+                for (x=bx ; x<xend ; x++)
+                {
+                    *dest++ = *src;
+                    src += viewheight;
+                }
+            }
+        }
+    }
+}
  
  
 
@@ -33,6 +33,13 @@ extern fixed_t		dc_texturemid;
 // first pixel in a column
 extern byte*		dc_source;		
 
+// [SVE] step between pixels for the column and span drawers
+extern int		dc_pitch;
+extern int		ds_pitch;
+
+// [SVE] render the view column-major, see R_TransposeViewBuffer
+extern boolean		r_columnmajor;
+
 
 // The span blitting interface.
 // Hook in assembler or system specific BLT
@@ -93,6 +100,9 @@ R_InitBuffer
 ( int		width,
   int		height );
 
+// [SVE] copy the column-major view to the screen
+void	R_TransposeViewBuffer (void);
+
 
 // Initialize color translation tables,
 //  for player rendering etc.
@@ -25,12 +25,16 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
 
 
 #include "doomdef.h"
 #include "doomstat.h"   // villsa [STRIFE]
 #include "d_main.h"
+#include "i_timer.h"
+#include "z_zone.h"
 
+#include "m_argv.h"
 #include "m_bbox.h"
 #include "m_menu.h"
 
@@ -744,6 +748,7 @@ void R_ExecuteSetViewSize (void)
 	dy = abs(dy);
 	yslope[i] = FixedDiv ( (viewwidth<<detailshift)/2*FRACUNIT, dy);
     }
+    R_ClearPlaneCache();
 	
     for (i=0 ; i<viewwidth ; i++)
     {
@@ -797,6 +802,15 @@ void R_Init (void)
     if(devparm)
         printf (".");
 
+    //!
+    // @category video
+    //
+    // Render the software view into a column-major buffer and
+    // transpose it to the screen at the end of the frame.
+    //
+
+    r_columnmajor = M_ParmExists("-columnmajor");
+
     R_SetViewSize (screenblocks, detailLevel);
     R_InitPlanes ();
     if(devparm)
@@ -822,6 +836,262 @@ void R_Init (void)
 }
 
 
+//
+// [SVE]: point-in-subsector grid.
+// Each 64-unit cell over the map's vertex bounds holds the deepest
+// node that every point in the cell reaches by the same path from the
+// root, or the subsector itself when the whole walk is shared. Lookups
+// pick the walk up from there, so they return exactly what a walk from
+// the root would.
+//
+
+#define PGRIDSHIFT      (FRACBITS+6)
+#define PGRIDMAXCELLS   (1 << 20)
+
+// R_PointOnSide truncates the partition delta and takes a sign-bit
+// shortcut; away from this band around the line both agree with the
+// exact cross product
+#define PGRIDMARGIN     (4*FRACUNIT)
+
+static int*     pointgrid;
+static int      pgridwidth;
+static int      pgridheight;
+static fixed_t  pgridorgx;
+static fixed_t  pgridorgy;
+
+//
+// R_BoxOnNodeSide
+// Returns the side every point of the box falls on in R_PointOnSide,
+//  or -1 if that can't be guaranteed.
+//
+static int R_BoxOnNodeSide (node_t *node, int64_t x0, int64_t y0,
+                            int64_t x1, int64_t y1)
+{
+    int64_t ndx = node->dx >> FRACBITS;
+    int64_t ndy = node->dy >> FRACBITS;
+    int64_t dx;
+    int64_t dy;
+    int64_t cross;
+    int     front = 0;
+    int     back = 0;
+    int     i;
+
+    // a partition under a unit long loses its sign when truncated
+    if ((node->dx > 0 && !ndx) || (node->dy > 0 && !ndy))
+        return -1;
+
+    for (i = 0; i < 4; i++)
+    {
+        dx = ((i & 1) ? x1 : x0) - node->x;
+        dy = ((i & 2) ? y1 : y0) - node->y;
+
+        // the walk's own subtraction would wrap here
+        if (dx < INT_MIN || dx > INT_MAX || dy < INT_MIN || dy > INT_MAX)
+            return -1;
+
+        cross = ndy * dx - ndx * dy;
+
+        if (cross > PGRIDMARGIN)
+            front++;
+        else if (cross < -PGRIDMARGIN)
+            back++;
+        else
+            return -1;
+    }
+
+    if (front == 4)
+        return 0;
+    if (back == 4)
+        return 1;
+
+    return -1;
+}
+
+//
+// R_WalkToSubsector
+//
+static int R_WalkToSubsector (fixed_t x, fixed_t y, int nodenum)
+{
+    node_t*	node;
+
+    while (!(nodenum & NF_SUBSECTOR))
+    {
+	node = &nodes[nodenum];
+	nodenum = node->children[R_PointOnSide(x, y, node)];
+    }
+
+    return nodenum & ~NF_SUBSECTOR;
+}
+
+//
+// R_CheckPointGrid
+// -devparm: checks the grid against walks from the root, at every
+//  vertex, line midpoint and a spread of points over the map, and
+//  reports how long each takes.
+//
+#define PGRIDCHECKPOINTS 65536
+
+static void R_CheckPointGrid (void)
+{
+    fixed_t*    px;
+    fixed_t*    py;
+    uint64_t    start;
+    uint64_t    walkus;
+    uint64_t    gridus;
+    unsigned    seed = 1;
+    int         count = 0;
+    int         bad = 0;
+    int         walksum = 0;
+    int         gridsum = 0;
+    int         i;
+
+    px = Z_Malloc(PGRIDCHECKPOINTS * sizeof(*px), PU_STATIC, NULL);
+    py = Z_Malloc(PGRIDCHECKPOINTS * sizeof(*py), PU_STATIC, NULL);
+
+    for (i = 0; i < numvertexes && count < PGRIDCHECKPOINTS; i++, count++)
+    {
+        px[count] = vertexes[i].x;
+        py[count] = vertexes[i].y;
+    }
+
+    for (i = 0; i < numlines && count < PGRIDCHECKPOINTS; i++, count++)
+    {
+        px[count] = lines[i].v1->x + lines[i].dx / 2;
+        py[count] = lines[i].v1->y + lines[i].dy / 2;
+    }
+
+    // keep the game's random number generator out of this
+    for ( ; count < PGRIDCHECKPOINTS; count++)
+    {
+        // 24 random bits scaled over the grid's extent in map units
+        seed = seed * 1103515245 + 12345;
+        px[count] = pgridorgx + (fixed_t)(((int64_t)(seed >> 8) *
+                    ((int64_t)pgridwidth << (PGRIDSHIFT - FRACBITS))) >> 8);
+        seed = seed * 1103515245 + 12345;
+        py[count] = pgridorgy + (fixed_t)(((int64_t)(seed >> 8) *
+                    ((int64_t)pgridheight << (PGRIDSHIFT - FRACBITS))) >> 8);
+    }
+
+    start = I_GetTimeUS();
+    for (i = 0; i < count; i++)
+        walksum += R_WalkToSubsector(px[i], py[i], numnodes-1);
+    walkus = I_GetTimeUS() - start;
+
+    start = I_GetTimeUS();
+    for (i = 0; i < count; i++)
+        gridsum += R_PointInSubsector(px[i], py[i]) - subsectors;
+    gridus = I_GetTimeUS() - start;
+
+    for (i = 0; i < count; i++)
+    {
+        if (R_WalkToSubsector(px[i], py[i], numnodes-1) !=
+            R_PointInSubsector(px[i], py[i]) - subsectors)
+            bad++;
+    }
+
+    if (walksum != gridsum)
+        bad = MAX(bad, 1);
+
+    printf("R_CheckPointGrid: %i points, %i mismatched; root walk %ius, "
+           "grid %ius\n", count, bad, (int)walkus, (int)gridus);
+
+    Z_Free(px);
+    Z_Free(py);
+}
+
+//
+// R_InitPointGrid
+// Called from P_SetupLevel once the nodes are loaded.
+//
+void R_InitPointGrid (void)
+{
+    fixed_t     minx = INT_MAX;
+    fixed_t     miny = INT_MAX;
+    fixed_t     maxx = INT_MIN;
+    fixed_t     maxy = INT_MIN;
+    int64_t     x0;
+    int64_t     y0;
+    int         nodenum;
+    int         side;
+    int         direct;
+    int         cx;
+    int         cy;
+    int         i;
+
+    //!
+    // @category video
+    //
+    // Disable the subsector lookup grid and walk the BSP from the root
+    // for every point, for comparison.
+    //
+
+    if (M_ParmExists("-nopointgrid") || !numnodes)
+    {
+        pointgrid = NULL;
+        return;
+    }
+
+    for (i = 0; i < numvertexes; i++)
+    {
+        minx = MIN(minx, vertexes[i].x);
+        miny = MIN(miny, vertexes[i].y);
+        maxx = MAX(maxx, vertexes[i].x);
+        maxy = MAX(maxy, vertexes[i].y);
+    }
+
+    pgridorgx = minx;
+    pgridorgy = miny;
+    pgridwidth = (int)((((int64_t)maxx - minx) >> PGRIDSHIFT) + 1);
+    pgridheight = (int)((((int64_t)maxy - miny) >> PGRIDSHIFT) + 1);
+
+    if ((int64_t)pgridwidth * pgridheight > PGRIDMAXCELLS)
+    {
+        pointgrid = NULL;
+        return;
+    }
+
+    Z_Malloc(pgridwidth * pgridheight * sizeof(*pointgrid), PU_LEVEL,
+             (void **)&pointgrid);
+
+    direct = 0;
+
+    for (cy = 0; cy < pgridheight; cy++)
+    {
+        y0 = (int64_t)pgridorgy + ((int64_t)cy << PGRIDSHIFT);
+
+        for (cx = 0; cx < pgridwidth; cx++)
+        {
+            x0 = (int64_t)pgridorgx + ((int64_t)cx << PGRIDSHIFT);
+
+            nodenum = numnodes-1;
+
+            while (!(nodenum & NF_SUBSECTOR))
+            {
+                side = R_BoxOnNodeSide(&nodes[nodenum], x0, y0,
+                                       x0 + (1 << PGRIDSHIFT) - 1,
+                                       y0 + (1 << PGRIDSHIFT) - 1);
+                if (side < 0)
+                    break;
+
+                nodenum = nodes[nodenum].children[side];
+            }
+
+            if (nodenum & NF_SUBSECTOR)
+                direct++;
+
+            pointgrid[cy * pgridwidth + cx] = nodenum;
+        }
+    }
+
+    if (devparm)
+    {
+        printf("R_InitPointGrid: %ix%i cells, %i%% resolve directly\n",
+               pgridwidth, pgridheight,
+               direct * 100 / (pgridwidth * pgridheight));
+        R_CheckPointGrid();
+    }
+}
+
 //
 // R_PointInSubsector
 //
@@ -833,6 +1103,8 @@ R_PointInSubsector
     node_t*	node;
     int		side;
     int		nodenum;
+    int64_t	cx;
+    int64_t	cy;
 
     // single subsector is a special case
     if (!numnodes)				
@@ -840,6 +1112,16 @@ R_PointInSubsector
 		
     nodenum = numnodes-1;
 
+    // [SVE]: start from the point's grid cell
+    if (pointgrid)
+    {
+	cx = ((int64_t)x - pgridorgx) >> PGRIDSHIFT;
+	cy = ((int64_t)y - pgridorgy) >> PGRIDSHIFT;
+
+	if (cx >= 0 && cx < pgridwidth && cy >= 0 && cy < pgridheight)
+	    nodenum = pointgrid[cy * pgridwidth + cx];
+    }
+
     while (! (nodenum & NF_SUBSECTOR) )
     {
 	node = &nodes[nodenum];
@@ -884,6 +1166,7 @@ void R_SetupPitch(player_t* player)
             yslope[i] = FixedDiv(viewwidth / 2 * FRACUNIT,
                                  abs(((i - centery) << FRACBITS) + (FRACUNIT/2)));
         }
+        R_ClearPlaneCache();
     }
 }
 
@@ -1100,6 +1383,9 @@ void R_RenderPlayerView (player_t* player)
     
     R_DrawMasked ();
 
+    // [SVE] flush the column-major view, if in use
+    R_TransposeViewBuffer ();
+
     // haleyjd 20140904: [SVE] remove sector interpolations
     if(viewlerp != FRACUNIT)
         R_SetSectorInterpolationState(SEC_NORMAL);
@@ -137,6 +137,9 @@ R_PointInSubsector
 ( fixed_t	x,
   fixed_t	y );
 
+// [SVE]: build the R_PointInSubsector lookup grid for the level
+void R_InitPointGrid (void);
+
 void
 R_AddPointToBox
 ( int		x,
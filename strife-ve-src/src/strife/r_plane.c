@@ -46,19 +46,26 @@ planefunction_t		ceilingfunc;
 // haleyjd 20100829: [STRIFE] MAXVISPLANES increased to 200
 // haleyjd 20140831: [SVE] removed limit; shoutouts to Lee Killough
 #define NUMINITVISPLANES   200
-#define MAXVISPLANES	   128
 visplane_t   initvisplanes[NUMINITVISPLANES];
-visplane_t  *visplanes[MAXVISPLANES];
 visplane_t  *freetail;
 visplane_t **freehead = &freetail;
 
 visplane_t *floorplane;
 visplane_t *ceilingplane;
 
-#define planehash(pic, light, height) \
-    (((unsigned)(pic)*3 +             \
-      (unsigned)(light) +             \
-      (unsigned)(height >> 16)*7) & (MAXVISPLANES - 1))
+// [SVE]: the visplane hash starts at 128 chains and is doubled at the
+// start of a frame whenever the last one averaged more than two planes
+// per chain. A Fibonacci hash spreads nearby heights and flat numbers
+// over all of it.
+#define INITVISPLANEHASHBITS 7
+static visplane_t **visplanes;
+static int          visplanehashbits;
+static int          numvisplanehash;
+static int          numvisplanesused;
+
+#define planehash(pic, light, height)                   \
+    (((((unsigned)(pic) * 31u + (unsigned)(light)) * 31u + \
+       (unsigned)((height) >> 16)) * 0x9E3779B1u) >> (32 - visplanehashbits))
 
 // ?
 // haleyjd 20140831: [SVE] MAXOPENINGS raised to proper limit
@@ -93,10 +100,16 @@ fixed_t			distscale[SCREENWIDTH];
 fixed_t			basexscale;
 fixed_t			baseyscale;
 
+// [SVE]: planeheight * yslope only changes with the plane height and
+// the yslope table, so the per-row distance is kept across frames until
+// R_ClearPlaneCache. The steps also depend on the view angle, and are
+// only reused within the frame they were worked out in.
 fixed_t			cachedheight[SCREENHEIGHT];
 fixed_t			cacheddistance[SCREENHEIGHT];
 fixed_t			cachedxstep[SCREENHEIGHT];
 fixed_t			cachedystep[SCREENHEIGHT];
+static unsigned int	cachedstepframe[SCREENHEIGHT];
+static unsigned int	planeframe = 1;
 
 
 
@@ -108,6 +121,10 @@ void R_InitPlanes(void)
 {
     int i = 0;
 
+    visplanehashbits = INITVISPLANEHASHBITS;
+    numvisplanehash = 1 << visplanehashbits;
+    visplanes = Z_Calloc(numvisplanehash, sizeof(*visplanes), PU_STATIC, NULL);
+
     // haleyjd 20140831: [SVE] add init planes to the visplane hash;
     // R_ClearPlanes will move them to the free list the first time it runs.
     for(; i < NUMINITVISPLANES; i++)
@@ -115,6 +132,22 @@ void R_InitPlanes(void)
         initvisplanes[i].next = visplanes[0];
         visplanes[0] = &initvisplanes[i];
     }
+
+    R_ClearPlaneCache();
+}
+
+
+//
+// R_ClearPlaneCache
+// [SVE]: Call whenever yslope is rebuilt.
+//
+void R_ClearPlaneCache(void)
+{
+    int i;
+
+    // plane heights are never negative, so nothing matches
+    for(i = 0; i < SCREENHEIGHT; i++)
+        cachedheight[i] = -1;
 }
 
 
@@ -152,17 +185,22 @@ R_MapPlane
     if (planeheight != cachedheight[y])
     {
         cachedheight[y] = planeheight;
-        distance = cacheddistance[y] = FixedMul (planeheight, yslope[y]);
-        ds_xstep = cachedxstep[y] = FixedMul (distance,basexscale);
-        ds_ystep = cachedystep[y] = FixedMul (distance,baseyscale);
+        cacheddistance[y] = FixedMul (planeheight, yslope[y]);
+        cachedstepframe[y] = planeframe - 1;
     }
-    else
+
+    distance = cacheddistance[y];
+
+    if (cachedstepframe[y] != planeframe)
     {
-        distance = cacheddistance[y];
-        ds_xstep = cachedxstep[y];
-        ds_ystep = cachedystep[y];
+        cachedstepframe[y] = planeframe;
+        cachedxstep[y] = FixedMul (distance,basexscale);
+        cachedystep[y] = FixedMul (distance,baseyscale);
     }
 
+    ds_xstep = cachedxstep[y];
+    ds_ystep = cachedystep[y];
+
     length = FixedMul (distance,distscale[x1]);
     angle = (viewangle + xtoviewangle[x1])>>ANGLETOFINESHIFT;
     ds_xfrac = viewx + FixedMul(finecosine[angle], length);
@@ -206,16 +244,29 @@ void R_ClearPlanes (void)
     }
 
     // haleyjd 20140831: [SVE] free visplanes
-    for(i = 0; i < MAXVISPLANES; i++)
+    for(i = 0; i < numvisplanehash; i++)
     {
         for(*freehead = visplanes[i], visplanes[i] = NULL; *freehead; )
             freehead = &(*freehead)->next;
     }
 
+    // [SVE]: every chain is empty now, so growing is just a new table
+    if(numvisplanesused > numvisplanehash * 2 && visplanehashbits < 16)
+    {
+        while(numvisplanesused > (1 << visplanehashbits) * 2 && visplanehashbits < 16)
+            visplanehashbits++;
+
+        numvisplanehash = 1 << visplanehashbits;
+        Z_Free(visplanes);
+        visplanes = Z_Calloc(numvisplanehash, sizeof(*visplanes), PU_STATIC, NULL);
+    }
+
+    numvisplanesused = 0;
+
     lastopening = openings;
 
-    // texture calculation
-    memset (cachedheight, 0, sizeof(cachedheight));
+    // texture calculation; distances carry over, steps don't
+    planeframe++;
 
     // left to right mapping
     angle = (viewangle-ANG90)>>ANGLETOFINESHIFT;
@@ -234,6 +285,7 @@ static visplane_t *R_newVisplane(unsigned int hash)
         freehead = &freetail;
     check->next = visplanes[hash];
     visplanes[hash] = check;
+    numvisplanesused++;
     return check;
 }
 
@@ -401,7 +453,7 @@ void R_DrawPlanes (void)
     int			angle;
     int                 lumpnum;
 
-    for(i = 0; i < MAXVISPLANES; i++)
+    for(i = 0; i < numvisplanehash; i++)
     {
         for(pl = visplanes[i]; pl; pl = pl->next)
         {
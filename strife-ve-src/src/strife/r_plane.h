@@ -42,6 +42,7 @@ extern fixed_t		distscale[SCREENWIDTH];
 
 void R_InitPlanes (void);
 void R_ClearPlanes (void);
+void R_ClearPlaneCache (void);
 
 void
 R_MapPlane
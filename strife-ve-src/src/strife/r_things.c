@@ -29,6 +29,7 @@
 
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -283,8 +284,11 @@ void R_InitSpriteDefs (char** namelist)
 //
 // GAME FUNCTIONS
 //
-vissprite_t	vissprites[MAXVISSPRITES];
+
+// [SVE]: vissprites grow on demand
+vissprite_t*	vissprites;
 vissprite_t*	vissprite_p;
+unsigned int	maxvissprites;
 int		newvissprite;
 int             sprbotscreen;       // villsa [STRIFE]
 
@@ -321,12 +325,16 @@ void R_ClearSprites (void)
 //
 // R_NewVisSprite
 //
-vissprite_t	overflowsprite;
-
 vissprite_t* R_NewVisSprite (void)
 {
-    if (vissprite_p == &vissprites[MAXVISSPRITES])
-	return &overflowsprite;
+    // [SVE]: double the array when it fills up
+    if (vissprite_p == vissprites + maxvissprites)
+    {
+        unsigned int newmax = maxvissprites ? maxvissprites*2 : MAXVISSPRITES;
+        vissprites = Z_Realloc(vissprites, newmax * sizeof(*vissprites), PU_STATIC, NULL);
+        vissprite_p = vissprites + maxvissprites;
+        maxvissprites = newmax;
+    }
     
     vissprite_p++;
     return vissprite_p-1;
@@ -869,58 +877,90 @@ void R_DrawPlayerSprites (void)
 //
 // R_SortVisSprites
 //
-vissprite_t	vsprsortedhead;
+// [SVE]: stable bottom-up merge sort on scale over an array of
+// pointers, replacing the O(n^2) selection sort. Equal scales keep
+// the order they were generated in, same as before.
+//
+vissprite_t**		vissprite_order;
+static vissprite_t**	vissprite_scratch;
+static unsigned int	maxvissorted;
+spritestats_t		spritestats;
 
 
 void R_SortVisSprites (void)
 {
-    int			i;
-    int			count;
-    vissprite_t*	ds;
-    vissprite_t*	best;
-    vissprite_t		unsorted;
-    fixed_t		bestscale;
+    unsigned int	count;
+    unsigned int	width;
+    unsigned int	i;
+    vissprite_t**	src;
+    vissprite_t**	dst;
+    vissprite_t**	swap;
+    uint64_t		starttime;
 
     count = vissprite_p - vissprites;
-	
-    unsorted.next = unsorted.prev = &unsorted;
+    spritestats.visible = count;
+    spritestats.sort_us = 0;
 
     if (!count)
 	return;
-		
-    for (ds=vissprites ; ds<vissprite_p ; ds++)
+
+    starttime = I_GetTimeUS();
+
+    if (count > maxvissorted)
     {
-	ds->next = ds+1;
-	ds->prev = ds-1;
+        // keep pace with the vissprite array itself
+        maxvissorted = maxvissprites;
+        vissprite_order = Z_Realloc(vissprite_order, maxvissorted * sizeof(*vissprite_order), PU_STATIC, NULL);
+        vissprite_scratch = Z_Realloc(vissprite_scratch, maxvissorted * sizeof(*vissprite_scratch), PU_STATIC, NULL);
     }
-    
-    vissprites[0].prev = &unsorted;
-    unsorted.next = &vissprites[0];
-    (vissprite_p-1)->next = &unsorted;
-    unsorted.prev = vissprite_p-1;
-    
-    // pull the vissprites out by scale
 
-    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
     for (i=0 ; i<count ; i++)
+	vissprite_order[i] = &vissprites[i];
+
+    src = vissprite_order;
+    dst = vissprite_scratch;
+
+    for (width=1 ; width<count ; width*=2)
     {
-	bestscale = INT_MAX;
-        best = unsorted.next;
-	for (ds=unsorted.next ; ds!= &unsorted ; ds=ds->next)
+	for (i=0 ; i<count ; i+=width*2)
 	{
-	    if (ds->scale < bestscale)
+	    unsigned int mid = MIN(i+width, count);
+	    unsigned int hi = MIN(i+width*2, count);
+	    unsigned int l = i;
+	    unsigned int r = mid;
+	    unsigned int o = i;
+
+	    // already in order, as most neighbouring runs are
+	    if (mid == hi || src[mid-1]->scale <= src[mid]->scale)
+	    {
+		memcpy(dst+i, src+i, (hi-i) * sizeof(*src));
+		continue;
+	    }
+
+	    while (l < mid && r < hi)
 	    {
-		bestscale = ds->scale;
-		best = ds;
+		// take from the left on ties to keep the sort stable
+		if (src[r]->scale < src[l]->scale)
+		    dst[o++] = src[r++];
+		else
+		    dst[o++] = src[l++];
 	    }
+
+	    while (l < mid)
+		dst[o++] = src[l++];
+	    while (r < hi)
+		dst[o++] = src[r++];
 	}
-	best->next->prev = best->prev;
-	best->prev->next = best->next;
-	best->next = &vsprsortedhead;
-	best->prev = vsprsortedhead.prev;
-	vsprsortedhead.prev->next = best;
-	vsprsortedhead.prev = best;
+
+	swap = src;
+	src = dst;
+	dst = swap;
     }
+
+    if (src != vissprite_order)
+	memcpy(vissprite_order, src, count * sizeof(*src));
+
+    spritestats.sort_us = (int)(I_GetTimeUS() - starttime);
 }
 
 
@@ -1048,22 +1088,17 @@ void R_DrawSprite (vissprite_t* spr)
 //
 void R_DrawMasked (void)
 {
-    vissprite_t*	spr;
+    int			i;
+    int			count;
     drawseg_t*		ds;
 	
     R_SortVisSprites ();
 
-    if (vissprite_p > vissprites)
-    {
-	// draw all vissprites back to front
-	for (spr = vsprsortedhead.next ;
-	     spr != &vsprsortedhead ;
-	     spr=spr->next)
-	{
-	    
-	    R_DrawSprite (spr);
-	}
-    }
+    // draw all vissprites back to front
+    count = vissprite_p - vissprites;
+
+    for (i=0 ; i<count ; i++)
+	R_DrawSprite (vissprite_order[i]);
     
     // render any remaining masked mid textures
     // haleyjd 20140831: [SVE} remove undefined behavior
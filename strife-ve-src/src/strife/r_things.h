@@ -22,11 +22,25 @@
 
 
 
+// [SVE]: vissprites grow on demand; this is
+// now only the initial size of the array
 #define MAXVISSPRITES  	128
 
-extern vissprite_t	vissprites[MAXVISSPRITES];
+extern vissprite_t*	vissprites;
 extern vissprite_t*	vissprite_p;
-extern vissprite_t	vsprsortedhead;
+extern unsigned int	maxvissprites;
+
+// sorted back to front by R_SortVisSprites
+extern vissprite_t**	vissprite_order;
+
+// [SVE]: per-frame sprite statistics
+typedef struct
+{
+    int visible;                // vissprites generated this frame
+    int sort_us;                // time spent in R_SortVisSprites
+} spritestats_t;
+
+extern spritestats_t spritestats;
 
 // Constant arrays used for psprite clipping
 //  and initializing clipping.
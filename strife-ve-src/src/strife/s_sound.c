@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
 
 #include "i_sound.h"
 #include "i_system.h"
@@ -137,6 +138,34 @@ static int i_voicehandle = -1;
 // haleyjd 09/11/10: [STRIFE] whether to play voices or not
 int disable_voices = 0;
 
+// [SVE]: per-tic spatial cache. Listener-relative distance and stereo
+// separation only depend on the listener and origin positions, so they are
+// computed once per origin and shared by every channel and every new sound
+// coming from it until either end moves.
+
+#define NUMSPATIALSLOTS 64 // must be a power of two
+
+typedef struct
+{
+    mobj_t  *origin;
+    fixed_t  x;             // origin position when the slot was filled
+    fixed_t  y;
+    fixed_t  dist;          // approximate distance to the listener
+    int      sep;           // stereo separation (only valid if audible)
+    unsigned int stamp;     // matches spatialstamp while slot is valid
+} spatialslot_t;
+
+static spatialslot_t spatialslots[NUMSPATIALSLOTS];
+static unsigned int  spatialstamp = 1;
+
+static mobj_t  *spatial_listener;
+static fixed_t  spatial_lx;
+static fixed_t  spatial_ly;
+static angle_t  spatial_la;
+
+// [SVE]: counters for the stats overlay
+soundstats_t soundstats;
+
 //
 // Initializes sound stuff, including volume
 // Sets channels, SFX and music volume,
@@ -168,6 +197,9 @@ void S_Init(int sfxVolume, int musicVolume, int voiceVolume)
     // no sounds are playing, and they are not mus_paused
     mus_paused = 0;
 
+    // [SVE]: nothing is cached for any listener yet
+    spatial_listener = NULL;
+
     // Note that sounds have not been cached (yet).
     for (i=1 ; i<NUMSFX ; i++)
     {
@@ -362,38 +394,81 @@ static int S_GetChannel(mobj_t *origin, sfxinfo_t *sfxinfo, boolean isvoice)
 }
 
 //
-// Changes volume and stereo-separation variables
-//  from the norm of a sound effect to be played.
-// If the sound is not audible, returns a 0.
-// Otherwise, modifies parameters and returns 1.
+// S_SpatialSetListener
 //
-// [STRIFE]
-// haleyjd 20110220: changed to eliminate the gamemap == 8 hack that was
-// left over from Doom 1's original boss levels. Kind of amazing that Rogue
-// was able to catch the smallest things like that.
+// [SVE] Invalidates the spatial cache if the listener has moved or turned
+// since it was last filled.
 //
-static int S_AdjustSoundParams(mobj_t *listener, mobj_t *source,
-                               int *vol, int *sep)
+static void S_SpatialSetListener(mobj_t *listener)
 {
-    fixed_t        approx_dist;
+    if (listener == spatial_listener &&
+        listener->x == spatial_lx &&
+        listener->y == spatial_ly &&
+        listener->angle == spatial_la)
+    {
+        return;
+    }
+
+    spatial_listener = listener;
+    spatial_lx = listener->x;
+    spatial_ly = listener->y;
+    spatial_la = listener->angle;
+
+    // on wrap-around, clear the slots so no stale stamp can match
+    if (++spatialstamp == 0)
+    {
+        memset(spatialslots, 0, sizeof(spatialslots));
+        spatialstamp = 1;
+    }
+}
+
+//
+// S_SpatialLookup
+//
+// [SVE] Returns the cached distance and separation of source relative to
+// the listener, computing them on a miss. Sources beyond S_CLIPPING_DIST
+// are culled before the angle is ever calculated.
+//
+static spatialslot_t *S_SpatialLookup(mobj_t *listener, mobj_t *source)
+{
+    spatialslot_t *slot;
     fixed_t        adx;
     fixed_t        ady;
     angle_t        angle;
 
+    S_SpatialSetListener(listener);
+
+    slot = &spatialslots[((uintptr_t)source >> 4) & (NUMSPATIALSLOTS - 1)];
+
+    if (slot->stamp == spatialstamp && slot->origin == source &&
+        slot->x == source->x && slot->y == source->y)
+    {
+        soundstats.spatialhits++;
+        return slot;
+    }
+
+    soundstats.spatialmisses++;
+
+    slot->origin = source;
+    slot->x = source->x;
+    slot->y = source->y;
+    slot->stamp = spatialstamp;
+
     // calculate the distance to sound origin
     //  and clip it if necessary
     adx = abs(listener->x - source->x);
     ady = abs(listener->y - source->y);
 
     // From _GG1_ p.428. Appox. eucledian distance fast.
-    approx_dist = adx + ady - ((adx < ady ? adx : ady)>>1);
-    
+    slot->dist = adx + ady - ((adx < ady ? adx : ady)>>1);
+    slot->sep = NORM_SEP;
+
     // [STRIFE] removed gamemap == 8 hack
-    if (approx_dist > S_CLIPPING_DIST)
+    if (slot->dist > S_CLIPPING_DIST)
     {
-        return 0;
+        return slot;
     }
-    
+
     // angle of source to listener
     angle = R_PointToAngle2(listener->x,
                             listener->y,
@@ -412,11 +487,41 @@ static int S_AdjustSoundParams(mobj_t *listener, mobj_t *source,
     angle >>= ANGLETOFINESHIFT;
 
     // stereo separation
-    *sep = 128 - (FixedMul(S_STEREO_SWING, finesine[angle]) >> FRACBITS);
+    slot->sep = 128 - (FixedMul(S_STEREO_SWING, finesine[angle]) >> FRACBITS);
+
+    return slot;
+}
+
+//
+// Changes volume and stereo-separation variables
+//  from the norm of a sound effect to be played.
+// If the sound is not audible, returns a 0.
+// Otherwise, modifies parameters and returns 1.
+//
+// [STRIFE]
+// haleyjd 20110220: changed to eliminate the gamemap == 8 hack that was
+// left over from Doom 1's original boss levels. Kind of amazing that Rogue
+// was able to catch the smallest things like that.
+//
+// [SVE]: distance and separation now come from the spatial cache.
+//
+static int S_AdjustSoundParams(mobj_t *listener, mobj_t *source,
+                               int *vol, int *sep)
+{
+    spatialslot_t *slot;
+
+    slot = S_SpatialLookup(listener, source);
+
+    if (slot->dist > S_CLIPPING_DIST)
+    {
+        return 0;
+    }
+
+    *sep = slot->sep;
 
     // volume calculation
     // [STRIFE] Removed gamemap == 8 hack
-    if (approx_dist < S_CLOSE_DIST)
+    if (slot->dist < S_CLOSE_DIST)
     {
         *vol = snd_SfxVolume;
     }
@@ -424,7 +529,7 @@ static int S_AdjustSoundParams(mobj_t *listener, mobj_t *source,
     {
         // distance effect
         *vol = (snd_SfxVolume
-                * ((S_CLIPPING_DIST - approx_dist)>>FRACBITS))
+                * ((S_CLIPPING_DIST - slot->dist)>>FRACBITS))
             / S_ATTENUATOR; 
     }
 
@@ -493,6 +598,7 @@ void S_StartSound(void *origin_p, int sfx_id)
 
         if (!rc)
         {
+            soundstats.culled++;
             return;
         }
     }        
@@ -509,9 +615,12 @@ void S_StartSound(void *origin_p, int sfx_id)
 
     if (cnum < 0)
     {
+        soundstats.nochannel++;
         return;
     }
 
+    soundstats.played++;
+
     // increase the usefulness
     if (sfx->usefulness++ < 0)
     {
@@ -768,6 +877,7 @@ void S_UpdateSounds(mobj_t *listener)
                     
                     if (!audible)
                     {
+                        soundstats.culled++;
                         S_StopChannel(cnum);
                     }
                     else
@@ -90,6 +90,19 @@ void S_SetMusicVolume(int volume);
 void S_SetSfxVolume(int volume);
 void S_SetVoiceVolume(int volume); // haleyjd 09/11/10: [STRIFE]
 
+// [SVE]: spatial pass counters, reset by whoever displays them
+
+typedef struct
+{
+    int played;         // sounds that got a channel
+    int culled;         // sounds rejected or stopped as inaudible
+    int nochannel;      // audible sounds that lost on priority
+    int spatialhits;    // origins served from the spatial cache
+    int spatialmisses;  // origins whose distance/angle had to be computed
+} soundstats_t;
+
+extern soundstats_t soundstats;
+
 extern int snd_channels;
 
 extern int disable_voices;